@@ -19,21 +19,191 @@ void AASpawner::BeginPlay()
 	Super::BeginPlay();
 
 	UE_LOG(LogTemp, Warning, TEXT("AASpawner::BeginPlay()"));
+
+	if (!spawnable)
+		return;
+
+	PrewarmPool(PrewarmCount);
+
+	if (bStressBenchmarkOnBeginPlay)
+	{
+		RunStressBenchmark(StressBenchmarkCount);
+		return;
+	}
+
 	UE_LOG(LogTemp, Warning, TEXT("AASpawner spawning one %s"), *spawnable->GetFName().ToString());
 
-	//GetWorld()->SpawnActor(spawnable, &GetTransform());
-	ASpawnable *toSpawn = GetWorld()->SpawnActorDeferred<ASpawnable>(spawnable, GetTransform());
+	SpawnBatch(1, [transform = GetTransform()](int32) { return transform; });
+}
 
-//  AActor *newActor = GetWorld()->SpawnActor(this->actorToSpawn.Get(), GetActorTransform())
-	toSpawn->material = material;
+void AASpawner::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// pooled actors that never finished spawning would otherwise linger half-constructed
+	for (ASpawnable *actor : pool)
+		if (IsValid(actor))
+			actor->Destroy();
 
-	UGameplayStatics::FinishSpawningActor(toSpawn, GetTransform());
+	pool.Reset();
+	active.Reset();
+	queued.Reset();
+	queuedHead = 0;
 
+	Super::EndPlay(EndPlayReason);
 }
 
 // Called every frame
 void AASpawner::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
+
+	if (queuedHead == queued.Num())
+		return;
+
+	const double startSeconds = FPlatformTime::Seconds();
+	const double endSeconds = startSeconds + SpawnBudgetMs / 1000.0;
+
+	do
+		Activate(queued[queuedHead++]);
+	while (queuedHead < queued.Num() && FPlatformTime::Seconds() < endSeconds);
+
+	if (queuedHead == queued.Num())
+	{
+		queued.Reset();
+		queuedHead = 0;
+	}
+
+	if (!benchmark.running)
+		return;
+
+	const double frameSeconds = FPlatformTime::Seconds() - startSeconds;
+	benchmark.spawnSeconds += frameSeconds;
+	benchmark.maxFrameSeconds = FMath::Max(benchmark.maxFrameSeconds, frameSeconds);
+	++benchmark.frames;
+
+	if (GetNumQueued() == 0)
+	{
+		benchmark.running = false;
+		const double wallSeconds = FPlatformTime::Seconds() - benchmark.startSeconds;
+		UE_LOG(LogTemp, Warning,
+			TEXT("AASpawner stress benchmark: %d actors in %d frames, %.3f s wall (%.0f actors/s), %.3f s spawning (%.0f actors/s), %.3f ms/frame average, %.3f ms/frame max"),
+			benchmark.count, benchmark.frames, wallSeconds, benchmark.count / wallSeconds,
+			benchmark.spawnSeconds, benchmark.count / benchmark.spawnSeconds,
+			1000.0 * benchmark.spawnSeconds / benchmark.frames, 1000.0 * benchmark.maxFrameSeconds);
+	}
+}
+
+//==============================================================================
+
+void AASpawner::SpawnBatch(const int32 count, TransformGenerator transformGenerator, MaterialGenerator materialGenerator)
+{
+	queued.Reserve(queued.Num() + count);
+
+	for (int32 i = 0; i < count; ++i)
+		queued.Add({transformGenerator(i), materialGenerator ? materialGenerator(i) : material});
+}
+
+void AASpawner::SpawnAtTransforms(const TArray<FTransform> &transforms, const TArray<UMaterialInterface*> &materials)
+{
+	MaterialGenerator materialGenerator;
+	if (!materials.IsEmpty())
+		materialGenerator = [&](int32 i) { return materials[i % materials.Num()]; };
+
+	SpawnBatch(transforms.Num(), [&](int32 i) { return transforms[i]; }, MoveTemp(materialGenerator));
+}
+
+void AASpawner::PrewarmPool(const int32 count)
+{
+	if (!spawnable)
+		return;
+
+	const double startSeconds = FPlatformTime::Seconds();
+	const int32 numToSpawn = count - pool.Num();
+
+	FActorSpawnParameters spawnParameters;
+	spawnParameters.bDeferConstruction = true;
+	spawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	spawnParameters.Owner = this;
+
+	// left deferred: construction scripts and BeginPlay run on first activation, with the real transform and material
+	for (int32 i = 0; i < numToSpawn; ++i)
+		if (ASpawnable *actor = GetWorld()->SpawnActor<ASpawnable>(spawnable, GetTransform(), spawnParameters))
+			pool.Add(actor);
+
+	if (numToSpawn > 0)
+		UE_LOG(LogTemp, Warning, TEXT("AASpawner prewarmed %d %s in %.3f ms"),
+			numToSpawn, *spawnable->GetFName().ToString(), 1000.0 * (FPlatformTime::Seconds() - startSeconds));
+}
+
+void AASpawner::Despawn(ASpawnable *actor)
+{
+	if (!actor || active.RemoveSingleSwap(actor, false) == 0)
+		return;
+
+	actor->ReturnToPool();
+	pool.Add(actor);
+}
+
+void AASpawner::DespawnAll()
+{
+	for (ASpawnable *actor : active)
+		if (IsValid(actor))
+		{
+			actor->ReturnToPool();
+			pool.Add(actor);
+		}
+
+	active.Reset();
+	queued.Reset();
+	queuedHead = 0;
+	benchmark.running = false;
 }
 
+void AASpawner::RunStressBenchmark(const int32 count)
+{
+	// with nothing to spawn, Tick would never see the benchmark through
+	if (!spawnable || count <= 0)
+		return;
+
+	DespawnAll();
+
+	const int32 side = FMath::CeilToInt(FMath::Sqrt(float(count)));
+	const FVector origin = GetActorLocation();
+	constexpr float spacing = 200.f;
+
+	benchmark = {};
+	benchmark.running = true;
+	benchmark.count = count;
+	benchmark.startSeconds = FPlatformTime::Seconds();
+
+	SpawnBatch(count, [=](const int32 i)
+	{
+		return FTransform{origin + FVector{(i % side - side / 2) * spacing, (i / side - side / 2) * spacing, 0.f}};
+	});
+}
+
+//------------------------------------------------------------------------------
+
+ASpawnable *AASpawner::PopPooled()
+{
+	while (!pool.IsEmpty())
+		if (ASpawnable *actor = pool.Pop(false); IsValid(actor))
+			return actor;
+
+	return GetWorld()->SpawnActorDeferred<ASpawnable>(spawnable, GetTransform(), this, nullptr, ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+}
+
+void AASpawner::Activate(const QueuedSpawn &spawn)
+{
+	ASpawnable *toSpawn = PopPooled();
+	if (!toSpawn)
+		return;
+
+	toSpawn->material = spawn.material;
+
+	if (toSpawn->IsActorInitialized())
+		toSpawn->TakeFromPool(spawn.transform);
+	else
+		UGameplayStatics::FinishSpawningActor(toSpawn, spawn.transform);
+
+	active.Add(toSpawn);
+}
@@ -8,20 +8,67 @@
 
 #include "ASpawner.generated.h"
 
+/**
+ * Spawns ASpawnable actors in batches.
+ *
+ * Actors come from a pool of deferred-constructed spawnables, which can be pre-warmed ahead of time.
+ * Spawn requests are queued and activated a few at a time each frame within SpawnBudgetMs,
+ * and despawned actors go back to the pool instead of being destroyed.
+ */
 UCLASS()
 class THIRDPERSON_API AASpawner : public AActor
 {
 	GENERATED_BODY()
-	
-public:	
+
+public:
 	// Sets default values for this actor's properties
 	AASpawner();
 
+	/** Picks the transform of the index'th actor in a batch. */
+	using TransformGenerator = TFunction<FTransform(int32 index)>;
+
+	/** Picks the material of the index'th actor in a batch; may return null. */
+	using MaterialGenerator = TFunction<UMaterialInterface*(int32 index)>;
+
+	/** Queues count actors for activation; they appear over the next frames. Without a material generator, material is used. */
+	void SpawnBatch(int32 count, TransformGenerator transformGenerator, MaterialGenerator materialGenerator = nullptr);
+
+	/** Queues one actor per transform. Materials are used in turn, repeating if there are fewer than transforms. */
+	UFUNCTION(BlueprintCallable, Category = "Spawning")
+	void SpawnAtTransforms(const TArray<FTransform> &transforms, const TArray<UMaterialInterface*> &materials);
+
+	/** Deferred-spawns actors until the pool holds at least count inactive ones. */
+	UFUNCTION(BlueprintCallable, Category = "Spawning")
+	void PrewarmPool(int32 count);
+
+	/** Hides the actor and returns it to the pool. */
+	UFUNCTION(BlueprintCallable, Category = "Spawning")
+	void Despawn(ASpawnable *actor);
+
+	/** Despawns every active actor and drops queued spawns. */
+	UFUNCTION(BlueprintCallable, Category = "Spawning")
+	void DespawnAll();
+
+	/** Spawns count actors on a grid around the spawner and logs spawn throughput and per-frame spawn cost once all are active. */
+	UFUNCTION(BlueprintCallable, Category = "Spawning")
+	void RunStressBenchmark(int32 count);
+
+	UFUNCTION(BlueprintPure, Category = "Spawning")
+	int32 GetNumActive() const { return active.Num(); }
+
+	UFUNCTION(BlueprintPure, Category = "Spawning")
+	int32 GetNumPooled() const { return pool.Num(); }
+
+	UFUNCTION(BlueprintPure, Category = "Spawning")
+	int32 GetNumQueued() const { return queued.Num() - queuedHead; }
+
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
-public:	
+	void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+public:
 	// Called every frame
 	void Tick(float DeltaTime) override;
 
@@ -30,4 +77,48 @@ public:
 
 	UPROPERTY(EditInstanceOnly)
 	UMaterialInterface *material;
+
+	/** Game thread time per frame spent activating queued spawns. At least one is activated every frame regardless. */
+	UPROPERTY(EditAnywhere, Category = "Spawning", meta = (ClampMin = "0.1", ClampMax = "100.0"))
+	float SpawnBudgetMs = 2.f;
+
+	/** Inactive actors deferred-spawned in BeginPlay so that the first waves don't pay for construction. */
+	UPROPERTY(EditAnywhere, Category = "Spawning", meta = (ClampMin = "0", ClampMax = "100000"))
+	int32 PrewarmCount = 0;
+
+	/** Runs RunStressBenchmark(StressBenchmarkCount) in BeginPlay instead of spawning a single actor. */
+	UPROPERTY(EditAnywhere, Category = "Spawning")
+	bool bStressBenchmarkOnBeginPlay = false;
+
+	UPROPERTY(EditAnywhere, Category = "Spawning", meta = (ClampMin = "1", ClampMax = "100000"))
+	int32 StressBenchmarkCount = 5000;
+
+private:
+	struct QueuedSpawn
+	{
+		FTransform transform;
+		UMaterialInterface *material;
+	};
+
+	ASpawnable *PopPooled();
+	void Activate(const QueuedSpawn &spawn);
+
+	UPROPERTY(Transient)
+	TArray<ASpawnable*> pool;
+
+	UPROPERTY(Transient)
+	TArray<ASpawnable*> active;
+
+	TArray<QueuedSpawn> queued; // consumed from queuedHead, compacted once drained
+	int32 queuedHead = 0;
+
+	struct Benchmark
+	{
+		bool running = false;
+		int32 count = 0;
+		int32 frames = 0;
+		double startSeconds = 0.0;
+		double spawnSeconds = 0.0;
+		double maxFrameSeconds = 0.0;
+	} benchmark;
 };
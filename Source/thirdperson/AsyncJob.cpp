@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "AsyncJob.h"
+
+#include "Async/Async.h"
+#include "Tasks/Task.h"
+
+void UAsyncJob::InitJob(const UObject *WorldContextObject)
+{
+  World = GEngine->GetWorldFromContextObject(WorldContextObject, EGetWorldErrorMode::LogAndReturnNull);
+  RegisterWithGameInstance(WorldContextObject);
+}
+
+void UAsyncJob::Launch(const float Priority, TUniqueFunction<void(FAsyncJobContext&)> Work, TUniqueFunction<void()> OnSucceeded)
+{
+  if (!GetWorld())
+  {
+    OnJobCancelled();
+    SetReadyToDestroy();
+    return;
+  }
+
+  bRunning = true;
+
+  // a background task rather than generation pool work, so that long jobs never hold up chunk generation,
+  // which may have as few as one worker
+  const UE::Tasks::ETaskPriority taskPriority =
+    Priority > 0.f ? UE::Tasks::ETaskPriority::BackgroundHigh
+    : Priority < 0.f ? UE::Tasks::ETaskPriority::BackgroundLow
+    : UE::Tasks::ETaskPriority::BackgroundNormal;
+
+  UE::Tasks::Launch(UE_SOURCE_LOCATION,
+    [context = Context, work = MoveTemp(Work), job = TWeakObjectPtr<UAsyncJob>{this}, onSucceeded = MoveTemp(OnSucceeded)]() mutable
+    {
+      if (!context->IsCancelRequested())
+        work(*context);
+
+      // registered with the game instance, so the job stays around until SetReadyToDestroy unless the game ends first
+      AsyncTask(ENamedThreads::GameThread, [job, onSucceeded = MoveTemp(onSucceeded)]
+      {
+        UAsyncJob *self = job.Get();
+        if (!self)
+          return;
+
+        self->bRunning = false;
+
+        if (self->Context->IsCancelRequested())
+          self->OnJobCancelled();
+        else
+        {
+          self->Context->SetProgress(1.f);
+          onSucceeded();
+        }
+
+        self->SetReadyToDestroy();
+      });
+    },
+    taskPriority);
+}
@@ -0,0 +1,84 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintAsyncActionBase.h"
+
+#include <atomic>
+
+#include "AsyncJob.generated.h"
+
+/** What a running job shares with its handle: progress one way, cancellation the other. Safe to use from any thread. */
+class THIRDPERSON_API FAsyncJobContext
+{
+public:
+  /** Fraction done, from 0 to 1. */
+  void SetProgress(float InProgress) { Progress = FMath::Clamp(InProgress, 0.f, 1.f); }
+  float GetProgress() const { return Progress; }
+
+  /** Jobs check this now and then and return early once it is set; what they return is then discarded. */
+  bool IsCancelRequested() const { return bCancelRequested; }
+  void RequestCancel() { bCancelRequested = true; }
+
+private:
+  std::atomic<float> Progress{0.f};
+  std::atomic<bool> bCancelRequested{false};
+};
+
+/**
+ * Base for Blueprint async nodes that run one job as a background task and deliver its result on the game
+ * thread. The node's handle can be polled for progress and cancelled while the job runs.
+ *
+ * Subclasses add a factory that stores the job's inputs and calls InitJob, start the job from Activate with
+ * StartJob<ResultType>, and broadcast their own typed result delegate from its completion. Cancelled jobs end in
+ * OnJobCancelled instead.
+ */
+UCLASS(Abstract, BlueprintType)
+class THIRDPERSON_API UAsyncJob : public UBlueprintAsyncActionBase
+{
+  GENERATED_BODY()
+
+public:
+  /** Fraction of the job done, from 0 to 1. */
+  UFUNCTION(BlueprintPure, Category = "Async Job")
+  float GetProgress() const { return Context->GetProgress(); }
+
+  /** Asks the job to stop early; it ends cancelled unless it had already finished. */
+  UFUNCTION(BlueprintCallable, Category = "Async Job")
+  void Cancel() { Context->RequestCancel(); }
+
+  UFUNCTION(BlueprintPure, Category = "Async Job")
+  bool IsRunning() const { return bRunning; }
+
+  UWorld *GetWorld() const override { return World.Get(); }
+
+protected:
+  /** Ties the job to WorldContextObject's world and keeps it alive until it ends. Call from the factory. */
+  void InitJob(const UObject *WorldContextObject);
+
+  /**
+   * Runs Work as a background task, of higher task priority if Priority is above 0 and lower if below, then OnSucceeded
+   * with what it returned on the game thread, or OnJobCancelled if the job was cancelled meanwhile. Work runs on a
+   * worker thread and must not touch this.
+   */
+  template<typename ResultType>
+  void StartJob(
+    float Priority, TUniqueFunction<ResultType(FAsyncJobContext &Context)> Work, TUniqueFunction<void(ResultType &&Result)> OnSucceeded)
+  {
+    const TSharedRef<ResultType, ESPMode::ThreadSafe> result = MakeShared<ResultType, ESPMode::ThreadSafe>();
+    Launch(Priority,
+      [result, work = MoveTemp(Work)](FAsyncJobContext &context) { *result = work(context); },
+      [result, onSucceeded = MoveTemp(OnSucceeded)] { onSucceeded(MoveTemp(*result)); });
+  }
+
+  /** Called on the game thread instead of the job's completion when it was cancelled, or could not be started. */
+  virtual void OnJobCancelled() {}
+
+private:
+  void Launch(float Priority, TUniqueFunction<void(FAsyncJobContext &Context)> Work, TUniqueFunction<void()> OnSucceeded);
+
+  TWeakObjectPtr<UWorld> World;
+  TSharedRef<FAsyncJobContext, ESPMode::ThreadSafe> Context = MakeShared<FAsyncJobContext, ESPMode::ThreadSafe>();
+  bool bRunning = false;
+};
@@ -3,6 +3,9 @@
 
 #include "Chunk.h"
 
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "PhysicsEngine/BodySetup.h"
+
 AChunk::AChunk()
 {
   StaticMeshComponent = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("AChunk static mesh"), true);
@@ -36,3 +39,70 @@ void AChunk::OnConstruction(const FTransform& transform)
   // StaticMeshComponent->bDrawMeshCollisionIfComplex = true; // actually draws mesh collision wireframe at least in PIE
   // StaticMeshComponent->bTraceComplexOnMove = true; // doesn't seem to affect pawn
 }
+
+void AChunk::SetHeightfieldCollision(TUniquePtr<Chaos::FHeightField> heightfield)
+{
+  if (!heightfield)
+  {
+    // back to colliding through the static mesh
+    if (HeightfieldCollisionComponent)
+    {
+      HeightfieldCollisionComponent->DestroyComponent();
+      HeightfieldCollisionComponent = nullptr;
+    }
+    StaticMeshComponent->SetCollisionEnabled(ECollisionEnabled::QueryAndPhysics);
+    return;
+  }
+
+  if (!HeightfieldCollisionComponent)
+  {
+    HeightfieldCollisionComponent = NewObject<UChunkHeightfieldCollisionComponent>(this, TEXT("AChunk heightfield collision"));
+    HeightfieldCollisionComponent->SetupAttachment(RootComponent);
+    HeightfieldCollisionComponent->SetHeightfield(MoveTemp(heightfield));
+    HeightfieldCollisionComponent->RegisterComponent();
+  }
+  else
+    HeightfieldCollisionComponent->SetHeightfield(MoveTemp(heightfield));
+
+  // the static mesh then only renders
+  StaticMeshComponent->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+}
+
+void AChunk::ClearCollision()
+{
+  if (HeightfieldCollisionComponent)
+  {
+    HeightfieldCollisionComponent->DestroyComponent();
+    HeightfieldCollisionComponent = nullptr;
+  }
+
+  // also drops the physics state, after which the cooked meshes can go
+  StaticMeshComponent->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+
+  if (UStaticMesh *staticMesh = StaticMeshComponent->GetStaticMesh())
+    if (UBodySetup *bodySetup = staticMesh->GetBodySetup())
+      bodySetup->ClearPhysicsMeshes();
+}
+
+void AChunk::AddScatter(UStaticMesh *mesh, const TArray<FTransform> &instanceTransforms, const bool bCollision, const int32 cullDistance)
+{
+  UHierarchicalInstancedStaticMeshComponent *instances = NewObject<UHierarchicalInstancedStaticMeshComponent>(this);
+  instances->SetStaticMesh(mesh);
+  instances->SetMobility(EComponentMobility::Static);
+  instances->SetCollisionEnabled(bCollision ? ECollisionEnabled::QueryAndPhysics : ECollisionEnabled::NoCollision);
+  instances->SetCullDistances(0, cullDistance);
+  instances->SetupAttachment(RootComponent);
+  instances->RegisterComponent();
+  instances->AddInstances(instanceTransforms, false);
+
+  ScatterComponents.Add(instances);
+}
+
+void AChunk::ClearScatter()
+{
+  for (UHierarchicalInstancedStaticMeshComponent *instances : ScatterComponents)
+    if (instances)
+      instances->DestroyComponent();
+
+  ScatterComponents.Reset();
+}
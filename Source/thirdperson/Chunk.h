@@ -5,8 +5,11 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 #include "ProceduralMeshComponent.h"
+#include "ChunkHeightfieldCollision.h"
 #include "Chunk.generated.h"
 
+class UHierarchicalInstancedStaticMeshComponent;
+
 UCLASS(Transient)
 class THIRDPERSON_API AChunk : public AActor
 {
@@ -22,6 +25,25 @@ public:
   
   UPROPERTY(EditAnywhere)
   UMaterialInterface* Material;
+
+  /** Only present when the chunk collides through a heightfield instead of its static mesh. */
+  UPROPERTY(VisibleAnywhere)
+  UChunkHeightfieldCollisionComponent *HeightfieldCollisionComponent;
+
+  /** Creates or replaces heightfield collision, or removes it given null; call after the chunk has finished spawning. */
+  void SetHeightfieldCollision(TUniquePtr<Chaos::FHeightField> heightfield);
+
+  /** Removes all terrain collision, releasing heightfield and cooked static mesh collision alike. Props are unaffected. */
+  void ClearCollision();
+
+  /** Instanced props on this chunk, one component per scatter layer that placed anything. */
+  UPROPERTY(VisibleAnywhere)
+  TArray<UHierarchicalInstancedStaticMeshComponent*> ScatterComponents;
+
+  /** Adds one batch of instances with transforms relative to the chunk; call after the chunk has finished spawning. */
+  void AddScatter(UStaticMesh *mesh, const TArray<FTransform> &instanceTransforms, bool bCollision, int32 cullDistance);
+
+  void ClearScatter();
   
   //==============================================================================
   // Runtime Virtual Texture support
@@ -0,0 +1,163 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ChunkHeightfieldCollision.h"
+
+#include "Chaos/ParticleHandle.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Physics/Experimental/PhysScene_Chaos.h"
+#include "Physics/PhysicsFiltering.h"
+#include "Physics/PhysicsInterfaceCore.h"
+#include "PhysicalMaterials/PhysicalMaterial.h"
+
+// adapted from ULandscapeHeightfieldCollisionComponent (LandscapeCollision.cpp), which does the same for landscape components
+
+UChunkHeightfieldCollisionComponent::UChunkHeightfieldCollisionComponent()
+{
+  SetCollisionProfileName(UCollisionProfile::BlockAll_ProfileName);
+  SetGenerateOverlapEvents(false);
+  SetMobility(EComponentMobility::Static);
+  CastShadow = false;
+  bUseAsOccluder = false;
+  SetHiddenInGame(true);
+  PrimaryComponentTick.bCanEverTick = false;
+}
+
+void UChunkHeightfieldCollisionComponent::SetHeightfield(TUniquePtr<Chaos::FHeightField> InHeightfield)
+{
+  if (IsPhysicsStateCreated())
+    DestroyPhysicsState();
+
+  // the old geometry lives on for as long as the physics particle still holds it
+  Heightfield = TSharedPtr<Chaos::FHeightField, ESPMode::ThreadSafe>{InHeightfield.Release()};
+
+  LocalBounds.Init();
+  NumSamples = 0;
+  if (Heightfield)
+  {
+    const Chaos::FAABB3 box = Heightfield->BoundingBox();
+    LocalBounds = FBox{FVector{box.Min()}, FVector{box.Max()}};
+    NumSamples = Heightfield->GetNumRows() * Heightfield->GetNumCols();
+  }
+
+  UpdateBounds();
+
+  if (IsRegistered())
+    RecreatePhysicsState();
+}
+
+SIZE_T UChunkHeightfieldCollisionComponent::GetHeightfieldMemorySize() const
+{
+  // quantized uint16 height per sample plus per-cell min/max and material data, roughly
+  return Heightfield ? sizeof(Chaos::FHeightField) + NumSamples * (sizeof(uint16) + sizeof(float) + sizeof(uint8)) : 0;
+}
+
+FBoxSphereBounds UChunkHeightfieldCollisionComponent::CalcBounds(const FTransform &LocalToWorld) const
+{
+  return LocalBounds.IsValid
+    ? FBoxSphereBounds{LocalBounds.TransformBy(LocalToWorld)}
+    : FBoxSphereBounds{LocalToWorld.GetLocation(), FVector::ZeroVector, 0.f};
+}
+
+void UChunkHeightfieldCollisionComponent::OnCreatePhysicsState()
+{
+  USceneComponent::OnCreatePhysicsState(); // route OnCreatePhysicsState, skip PrimitiveComponent implementation
+
+  if (BodyInstance.IsValidBodyInstance() || !Heightfield)
+    return;
+
+  UWorld *world = GetWorld();
+  FPhysScene *physScene = world ? world->GetPhysicsScene() : nullptr;
+  if (!physScene)
+    return;
+
+  const FTransform componentTransform = GetComponentToWorld();
+
+  FActorCreationParams params;
+  params.InitialTM = componentTransform;
+  params.InitialTM.SetScale3D(FVector(0.f));
+  params.bQueryOnly = false;
+  params.bStatic = true;
+  params.Scene = physScene;
+
+  FPhysicsActorHandle physHandle;
+  FPhysicsInterface::CreateActor(params, physHandle);
+  Chaos::FRigidBodyHandle_External &body = physHandle->GetGameThreadAPI();
+
+  // sample spacing is baked into the heightfield's scale; chunks are never scaled so the component scale is ignored.
+  // The particle shares ownership of the heightfield rather than referencing it, so that the physics thread can
+  // finish removing the particle after the component has let go of the geometry.
+  TSharedPtr<Chaos::FImplicitObject, ESPMode::ThreadSafe> geometry = Heightfield;
+
+  TUniquePtr<Chaos::FPerShapeData> shape = Chaos::FPerShapeData::CreatePerShapeData(0);
+
+  FCollisionFilterData queryFilterData, simFilterData;
+  CreateShapeFilterData(
+    GetCollisionObjectType(), FMaskFilter(0), GetOwner() ? GetOwner()->GetUniqueID() : 0,
+    GetCollisionResponseToChannels(), GetUniqueID(), 0, queryFilterData, simFilterData, true, false, true);
+
+  // the heightfield serves as both simple and complex collision
+  queryFilterData.Word3 |= EPDF_SimpleCollision | EPDF_ComplexCollision;
+  simFilterData.Word3 |= EPDF_SimpleCollision | EPDF_ComplexCollision;
+
+  shape->SetQueryData(queryFilterData);
+  shape->SetSimData(simFilterData);
+  shape->SetMaterial(GEngine->DefaultPhysMaterial->GetPhysicsMaterial());
+
+  body.SetGeometry(geometry);
+
+  shape->UpdateShapeBounds(Chaos::FRigidTransform3(body.X(), body.R()));
+  Chaos::FShapesArray shapes;
+  shapes.Emplace(MoveTemp(shape));
+  body.SetShapesArray(MoveTemp(shapes));
+
+  BodyInstance.PhysicsUserData = FPhysicsUserData(&BodyInstance);
+  BodyInstance.OwnerComponent = this;
+  BodyInstance.ActorHandle = physHandle;
+  body.SetUserData(&BodyInstance.PhysicsUserData);
+
+  TArray<FPhysicsActorHandle> actors;
+  actors.Add(physHandle);
+  FPhysicsCommand::ExecuteWrite(physScene, [&]()
+  {
+    physScene->AddActorsToScene_AssumesLocked(actors, true);
+  });
+  physScene->AddToComponentMaps(this, physHandle);
+}
+
+void UChunkHeightfieldCollisionComponent::OnDestroyPhysicsState()
+{
+  if (UWorld *world = GetWorld())
+    if (FPhysScene *physScene = world->GetPhysicsScene())
+    {
+      FPhysicsActorHandle &actorHandle = BodyInstance.GetPhysicsActorHandle();
+      if (FPhysicsInterface::IsValid(actorHandle))
+        physScene->RemoveFromComponentMaps(actorHandle);
+    }
+
+  Super::OnDestroyPhysicsState(); // terminates BodyInstance
+}
+
+//==============================================================================
+
+TUniquePtr<Chaos::FHeightField>
+makeChunkHeightfield(const TArrayView<const float> heights, const int32 resolution, const float size)
+{
+  const int32 numSamplesPerSide = resolution + 1;
+  check(heights.Num() == numSamplesPerSide * numSamplesPerSide);
+
+  TArray<Chaos::FReal> chaosHeights;
+  chaosHeights.Reserve(heights.Num());
+  for (const float height : heights)
+    chaosHeights.Add(height);
+
+  TArray<uint8> materialIndices;
+  materialIndices.Add(0); // one material for every cell
+
+  const float step = size / resolution;
+
+  // rows run along Y and columns along X, matching the row-major order of the chunk's heights
+  return MakeUnique<Chaos::FHeightField>(
+    MoveTemp(chaosHeights), MoveTemp(materialIndices), numSamplesPerSide, numSamplesPerSide, Chaos::FVec3(step, step, 1.f));
+}
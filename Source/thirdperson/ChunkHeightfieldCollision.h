@@ -0,0 +1,49 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Chaos/HeightField.h"
+#include "Components/PrimitiveComponent.h"
+#include "ChunkHeightfieldCollision.generated.h"
+
+/**
+ * Collision for one landscape chunk as a Chaos heightfield shape instead of a cooked triangle mesh.
+ * The heightfield is built from the chunk's sampled heights (on a worker, see makeChunkHeightfield) and handed
+ * over whole, so nothing needs cooking on the game thread and physics keeps only quantized heights per sample.
+ * Component-local space matches the chunk mesh: samples run from (0,0) to (size,size).
+ */
+UCLASS()
+class THIRDPERSON_API UChunkHeightfieldCollisionComponent : public UPrimitiveComponent
+{
+  GENERATED_BODY()
+
+public:
+  UChunkHeightfieldCollisionComponent();
+
+  /** Replaces the collision geometry, recreating the physics state if there is one. */
+  void SetHeightfield(TUniquePtr<Chaos::FHeightField> InHeightfield);
+
+  /** Approximate physics memory held by the heightfield. */
+  SIZE_T GetHeightfieldMemorySize() const;
+
+  //------------------------------------------------------------------------------
+  // UPrimitiveComponent
+
+  FBoxSphereBounds CalcBounds(const FTransform &LocalToWorld) const override;
+
+protected:
+  void OnCreatePhysicsState() override;
+  void OnDestroyPhysicsState() override;
+
+private:
+  // shared with the physics particle made from it, which the physics thread removes some time after the physics
+  // state is destroyed, so replacing or destroying the component never frees geometry physics may still read
+  TSharedPtr<Chaos::FHeightField, ESPMode::ThreadSafe> Heightfield;
+  FBox LocalBounds{ForceInit};
+  int32 NumSamples{};
+};
+
+/** Builds heightfield collision geometry from (resolution + 1)^2 row-major heights spaced size / resolution apart. */
+TUniquePtr<Chaos::FHeightField>
+makeChunkHeightfield(TArrayView<const float> heights, int32 resolution, float size);
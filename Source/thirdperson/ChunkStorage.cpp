@@ -0,0 +1,470 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ChunkStorage.h"
+
+#include "HAL/PlatformFileManager.h"
+#include "Misc/PackageName.h"
+#include "Misc/Paths.h"
+#include "ProceduralGenerationSubsystem.h"
+
+namespace
+{
+  // region file: FileHeader, then records, each a RecordHeader followed by Size bytes of data
+  constexpr uint32 FileMagic = 0x31475243;   // "CRG1"
+  constexpr uint32 FileVersion = 1;
+  constexpr uint32 RecordMagic = 0x43455243; // "CREC"
+
+  struct FileHeader
+  {
+    uint32 Magic;
+    uint32 Version;
+  };
+
+  struct RecordHeader
+  {
+    uint32 Magic;
+    int32 X, Y, Z; // chunk address
+    uint32 Size;   // 0 erases the chunk's data
+    uint32 Crc;    // of the data
+  };
+
+  static_assert(sizeof(FileHeader) == 8 && sizeof(RecordHeader) == 24, "region file headers are read and written as-is");
+
+  // a compaction writes the new file beside the old one, then sets the old one aside until the new one is in place
+  constexpr TCHAR CompactingSuffix[] = TEXT(".compacting");
+  constexpr TCHAR ReplacedSuffix[] = TEXT(".replaced");
+
+  constexpr int32 MaxOpenRegions = 64;
+  constexpr int64 MinCompactionBytes = 1024 * 1024; // superseded records below this are never worth a rewrite
+
+  int32
+  floorDiv(const int32 a, const int32 b)
+  {
+    return a >= 0 ? a / b : -((b - 1 - a) / b);
+  }
+} // namespace
+
+//==============================================================================
+
+// One region file of one channel: an index of its chunks' newest records, and appending to it.
+class UChunkStorage::FRegionFile
+{
+public:
+  // opens the file, creating it if there is none; null if it can't be opened or isn't a region file
+  static TUniquePtr<FRegionFile>
+  Open(const FString &InPath)
+  {
+    IPlatformFile &platformFile = FPlatformFileManager::Get().GetPlatformFile();
+    platformFile.CreateDirectoryTree(*FPaths::GetPath(InPath));
+
+    // finish a compaction cut short by a crash: once the old file has been set aside the compacted one is whole,
+    // and until then the old file is still in place
+    const FString compactingPath = InPath + CompactingSuffix;
+    const FString replacedPath = InPath + ReplacedSuffix;
+    if (!platformFile.FileExists(*InPath) && platformFile.FileExists(*replacedPath)
+      && !platformFile.MoveFile(*InPath, *compactingPath) && !platformFile.MoveFile(*InPath, *replacedPath))
+    {
+      UE_LOG(LogTemp, Error, TEXT("UChunkStorage: couldn't recover %s from an interrupted compaction"), *InPath);
+      return nullptr;
+    }
+    platformFile.DeleteFile(*replacedPath);
+    platformFile.DeleteFile(*compactingPath);
+
+    TUniquePtr<FRegionFile> region{new FRegionFile};
+    region->Path = InPath;
+    region->Handle.Reset(platformFile.OpenWrite(*InPath, true, true));
+    if (!region->Handle)
+    {
+      UE_LOG(LogTemp, Error, TEXT("UChunkStorage: couldn't open %s"), *InPath);
+      return nullptr;
+    }
+
+    region->FileSize = region->Handle->Size();
+
+    if (region->FileSize == 0)
+    {
+      const FileHeader header{FileMagic, FileVersion};
+      if (!region->Handle->Write(reinterpret_cast<const uint8*>(&header), sizeof(header)))
+      {
+        UE_LOG(LogTemp, Error, TEXT("UChunkStorage: couldn't write to %s"), *InPath);
+        return nullptr;
+      }
+      region->FileSize = sizeof(header);
+      return region;
+    }
+
+    FileHeader header;
+    if (region->FileSize < int64(sizeof(header))
+      || !region->Handle->Seek(0)
+      || !region->Handle->Read(reinterpret_cast<uint8*>(&header), sizeof(header))
+      || header.Magic != FileMagic || header.Version != FileVersion)
+    {
+      UE_LOG(LogTemp, Error, TEXT("UChunkStorage: %s is not a region file"), *InPath);
+      return nullptr;
+    }
+
+    // rebuild the index from the record headers, skipping their data
+    int64 offset = sizeof(header);
+    for (RecordHeader record; offset + int64(sizeof(record)) <= region->FileSize; offset += sizeof(record) + record.Size)
+    {
+      if (!region->Handle->Seek(offset)
+        || !region->Handle->Read(reinterpret_cast<uint8*>(&record), sizeof(record))
+        || record.Magic != RecordMagic
+        || offset + int64(sizeof(record)) + record.Size > region->FileSize)
+        break;
+
+      region->SetEntry({record.X, record.Y, record.Z}, {offset + int64(sizeof(record)), record.Size, record.Crc});
+    }
+
+    // a record cut short, most likely by a crash while it was being appended; everything before it is kept
+    // (appending resumes over it should the compaction fail)
+    if (offset != region->FileSize)
+    {
+      UE_LOG(LogTemp, Warning, TEXT("UChunkStorage: %s ends in a damaged record, which is dropped"), *InPath);
+      region->FileSize = offset;
+      region->Compact();
+    }
+
+    return region;
+  }
+
+  // the chunk's data, or empty data if it has none
+  TArray<uint8>
+  Read(const FIntVector ChunkAddress)
+  {
+    TArray<uint8> data;
+
+    const FEntry *entry = Index.Find(ChunkAddress);
+    if (!entry || !Handle)
+      return data;
+
+    data.SetNumUninitialized(entry->Size);
+    if (!Handle->Seek(entry->Offset) || !Handle->Read(data.GetData(), data.Num()) || FCrc::MemCrc32(data.GetData(), data.Num()) != entry->Crc)
+    {
+      UE_LOG(LogTemp, Warning, TEXT("UChunkStorage: chunk {%d, %d, %d} in %s is damaged, and ignored"),
+        ChunkAddress.X, ChunkAddress.Y, ChunkAddress.Z, *Path);
+      data.Reset();
+    }
+
+    return data;
+  }
+
+  // false if the data couldn't be written, in which case the chunk keeps what it had
+  bool
+  Write(const FIntVector ChunkAddress, const TArray<uint8> &Data)
+  {
+    if (!Handle)
+      return false;
+    if (Data.IsEmpty() && !Index.Contains(ChunkAddress))
+      return true;
+
+    const RecordHeader record{RecordMagic, ChunkAddress.X, ChunkAddress.Y, ChunkAddress.Z, uint32(Data.Num()), FCrc::MemCrc32(Data.GetData(), Data.Num())};
+
+    // seek even though the file was opened for appending: not every platform appends regardless of position;
+    // a record written in part is overwritten by the next one, or dropped as a damaged record when the file is reopened
+    if (!Handle->Seek(FileSize)
+      || !Handle->Write(reinterpret_cast<const uint8*>(&record), sizeof(record))
+      || !Handle->Write(Data.GetData(), Data.Num()))
+    {
+      UE_LOG(LogTemp, Error, TEXT("UChunkStorage: couldn't write chunk {%d, %d, %d} to %s"),
+        ChunkAddress.X, ChunkAddress.Y, ChunkAddress.Z, *Path);
+      return false;
+    }
+
+    SetEntry(ChunkAddress, {FileSize + int64(sizeof(record)), record.Size, record.Crc});
+    FileSize += sizeof(record) + record.Size;
+
+    if (FileSize - int64(sizeof(FileHeader)) - LiveBytes > FMath::Max(LiveBytes, MinCompactionBytes))
+      Compact();
+
+    return true;
+  }
+
+  void
+  Flush()
+  {
+    if (Handle)
+      Handle->Flush();
+  }
+
+  // false once the file couldn't be reopened after a compaction
+  bool
+  IsOpen() const
+  {
+    return Handle.IsValid();
+  }
+
+private:
+  struct FEntry
+  {
+    int64 Offset; // of the data, just past the record header
+    uint32 Size;
+    uint32 Crc;
+  };
+
+  FRegionFile() = default;
+
+  void
+  SetEntry(const FIntVector ChunkAddress, const FEntry &Entry)
+  {
+    FEntry previous;
+    if (Index.RemoveAndCopyValue(ChunkAddress, previous))
+      LiveBytes -= sizeof(RecordHeader) + previous.Size;
+
+    if (Entry.Size == 0)
+      return;
+
+    Index.Add(ChunkAddress, Entry);
+    LiveBytes += sizeof(RecordHeader) + Entry.Size;
+  }
+
+  // Rewrites the file with only the newest record of each chunk. The old file is set aside rather than deleted
+  // until the compacted one has been moved into its place, so that one of them is whole on disk at every step,
+  // and is kept along with the index if any step fails.
+  void
+  Compact()
+  {
+    IPlatformFile &platformFile = FPlatformFileManager::Get().GetPlatformFile();
+    const FString compactingPath = Path + CompactingSuffix;
+    const FString replacedPath = Path + ReplacedSuffix;
+
+    TMap<FIntVector, FEntry> compactedIndex;
+    int64 compactedSize = sizeof(FileHeader);
+    {
+      TUniquePtr<IFileHandle> compacting{platformFile.OpenWrite(*compactingPath)};
+      if (!compacting)
+      {
+        UE_LOG(LogTemp, Error, TEXT("UChunkStorage: couldn't compact %s"), *Path);
+        return;
+      }
+
+      const FileHeader header{FileMagic, FileVersion};
+      bool written = compacting->Write(reinterpret_cast<const uint8*>(&header), sizeof(header));
+
+      for (auto entry = Index.CreateConstIterator(); entry && written; ++entry)
+      {
+        const TArray<uint8> data = Read(entry.Key());
+        if (data.IsEmpty())
+          continue;
+
+        const RecordHeader record{RecordMagic, entry.Key().X, entry.Key().Y, entry.Key().Z, uint32(data.Num()), entry.Value().Crc};
+        written = compacting->Write(reinterpret_cast<const uint8*>(&record), sizeof(record))
+          && compacting->Write(data.GetData(), data.Num());
+
+        compactedIndex.Add(entry.Key(), {compactedSize + int64(sizeof(record)), record.Size, record.Crc});
+        compactedSize += sizeof(record) + record.Size;
+      }
+
+      if (!written || !compacting->Flush())
+      {
+        UE_LOG(LogTemp, Error, TEXT("UChunkStorage: couldn't compact %s"), *Path);
+        compacting.Reset();
+        platformFile.DeleteFile(*compactingPath);
+        return;
+      }
+    }
+
+    Handle.Reset();
+
+    platformFile.DeleteFile(*replacedPath);
+    bool replaced = false;
+    if (platformFile.MoveFile(*replacedPath, *Path))
+    {
+      replaced = platformFile.MoveFile(*Path, *compactingPath);
+      if (!replaced)
+        platformFile.MoveFile(*Path, *replacedPath);
+    }
+    platformFile.DeleteFile(*(replaced ? replacedPath : compactingPath));
+
+    Handle.Reset(platformFile.OpenWrite(*Path, true, true));
+    if (!Handle)
+    {
+      UE_LOG(LogTemp, Error, TEXT("UChunkStorage: couldn't reopen %s after compacting it"), *Path);
+      return;
+    }
+
+    if (!replaced)
+    {
+      UE_LOG(LogTemp, Error, TEXT("UChunkStorage: couldn't replace %s with its compacted copy"), *Path);
+      return;
+    }
+
+    Index = MoveTemp(compactedIndex);
+    FileSize = compactedSize;
+    LiveBytes = compactedSize - sizeof(FileHeader);
+  }
+
+  FString Path;
+  TUniquePtr<IFileHandle> Handle;
+  TMap<FIntVector, FEntry> Index; // newest record of each chunk that has data
+  int64 FileSize = 0;
+  int64 LiveBytes = 0;            // of the records in Index, headers included
+};
+
+//==============================================================================
+
+struct UChunkStorage::FShared
+{
+  FString Directory;
+
+  // worker thread only
+  TMap<TTuple<FName, FIntVector>, TUniquePtr<FRegionFile>> Regions; // by channel and region coordinates; open ones
+
+  FCriticalSection CompletedMutex;
+  TArray<FCompletion> Completed; // lock before access
+
+  // the region file holding the chunk, opened if it isn't already; null if it can't be, and tried again next time
+  FRegionFile *
+  GetRegion(const FName Channel, const FIntVector ChunkAddress)
+  {
+    const FIntVector region{floorDiv(ChunkAddress.X, RegionSize), floorDiv(ChunkAddress.Y, RegionSize), ChunkAddress.Z};
+    const TTuple<FName, FIntVector> key{Channel, region};
+
+    if (const TUniquePtr<FRegionFile> *open = Regions.Find(key))
+    {
+      if ((*open)->IsOpen())
+        return open->Get();
+      Regions.Remove(key);
+    }
+
+    // closing any one will do: streaming moves on from regions gradually, and reopening one is cheap
+    if (Regions.Num() >= MaxOpenRegions)
+    {
+      const TTuple<FName, FIntVector> closing = Regions.CreateConstIterator().Key();
+      Regions.Remove(closing);
+    }
+
+    const FString path = Directory / Channel.ToString() / FString::Printf(TEXT("r.%d.%d.%d.chunks"), region.X, region.Y, region.Z);
+    TUniquePtr<FRegionFile> opened = FRegionFile::Open(path);
+    if (!opened)
+      return nullptr;
+
+    return Regions.Add(key, MoveTemp(opened)).Get();
+  }
+};
+
+//==============================================================================
+
+void UChunkStorage::Initialize(FSubsystemCollectionBase &Collection)
+{
+  Super::Initialize(Collection);
+
+  const FString mapName = UWorld::RemovePIEPrefix(FPackageName::GetShortName(GetWorld()->GetOutermost()->GetName()));
+  Directory = FPaths::ProjectSavedDir() / TEXT("Chunks") / mapName;
+
+  Shared = MakeShared<FShared, ESPMode::ThreadSafe>();
+  Shared->Directory = Directory;
+}
+
+void UChunkStorage::Deinitialize()
+{
+  // queued saves are written before the worker ends
+  if (Worker)
+    Worker->Stop();
+  Worker.Reset();
+  Shared.Reset(); // closes the region files
+  Completing.Reset();
+
+  Super::Deinitialize();
+}
+
+TSharedPtr<FProceduralGenerationPool, ESPMode::ThreadSafe> UChunkStorage::GetWorker()
+{
+  // started by the first file access, since most worlds never persist anything
+  if (!Worker)
+    Worker = MakeShared<FProceduralGenerationPool, ESPMode::ThreadSafe>(1);
+
+  return Worker;
+}
+
+void UChunkStorage::Load(const FName Channel, const FIntVector ChunkAddress, const UObject *Owner, FOnChunkLoaded OnLoaded)
+{
+  GetWorker()->Submit([shared = Shared, Channel, ChunkAddress, owner = TWeakObjectPtr<const UObject>{Owner}, onLoaded = MoveTemp(OnLoaded)]() mutable
+  {
+    TArray<uint8> data;
+    if (FRegionFile *region = shared->GetRegion(Channel, ChunkAddress))
+      data = region->Read(ChunkAddress);
+
+    FScopeLock lock(&shared->CompletedMutex);
+    shared->Completed.Add({owner, [onLoaded = MoveTemp(onLoaded), data = MoveTemp(data)]() mutable { onLoaded(MoveTemp(data)); }});
+  });
+}
+
+void UChunkStorage::Save(const FName Channel, const FIntVector ChunkAddress, TArray<uint8> Data, const UObject *Owner, FOnChunkSaved OnSaved)
+{
+  GetWorker()->Submit([shared = Shared, Channel, ChunkAddress, data = MoveTemp(Data), owner = TWeakObjectPtr<const UObject>{Owner}, onSaved = MoveTemp(OnSaved)]() mutable
+  {
+    FRegionFile *region = shared->GetRegion(Channel, ChunkAddress);
+    const bool saved = region && region->Write(ChunkAddress, data);
+
+    if (onSaved)
+    {
+      FScopeLock lock(&shared->CompletedMutex);
+      shared->Completed.Add({owner, [onSaved = MoveTemp(onSaved), saved] { onSaved(saved); }});
+    }
+  });
+}
+
+void UChunkStorage::ClearChannel(const FName Channel)
+{
+  GetWorker()->Submit([shared = Shared, Channel]
+  {
+    for (auto it = shared->Regions.CreateIterator(); it; ++it)
+      if (it.Key().Get<0>() == Channel)
+        it.RemoveCurrent();
+
+    FPlatformFileManager::Get().GetPlatformFile().DeleteDirectoryRecursively(*(shared->Directory / Channel.ToString()));
+  });
+}
+
+void UChunkStorage::Flush()
+{
+  // nothing was ever queued
+  if (!Worker)
+    return;
+
+  FEvent *flushed = FPlatformProcess::GetSynchEventFromPool();
+
+  const bool submitted = Worker->Submit([shared = Shared, flushed]
+  {
+    for (const auto &region : shared->Regions)
+      region.Value->Flush();
+
+    flushed->Trigger();
+  });
+
+  if (submitted)
+    flushed->Wait();
+
+  FPlatformProcess::ReturnSynchEventToPool(flushed);
+
+  DeliverCompleted();
+}
+
+void UChunkStorage::Tick(float DeltaTime)
+{
+  DeliverCompleted();
+}
+
+void UChunkStorage::DeliverCompleted()
+{
+  if (!Shared)
+    return;
+
+  {
+    FScopeLock lock(&Shared->CompletedMutex);
+    Swap(Shared->Completed, Completing);
+  }
+
+  for (FCompletion &completion : Completing)
+    if (completion.Owner.IsExplicitlyNull() || completion.Owner.IsValid())
+      completion.OnComplete();
+
+  Completing.Reset();
+}
+
+TStatId UChunkStorage::GetStatId() const
+{
+  RETURN_QUICK_DECLARE_CYCLE_STAT(UChunkStorage, STATGROUP_Tickables);
+}
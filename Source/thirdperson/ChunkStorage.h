@@ -0,0 +1,89 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "ChunkStorage.generated.h"
+
+class FProceduralGenerationPool;
+
+/**
+ * Per-chunk data saved to disk, keyed by chunk address, for as long as the world's save directory is kept.
+ *
+ * Data is saved in channels, one per kind of data, so that each can be cleared without touching the others.
+ * A channel's chunks are grouped into region files of RegionSize x RegionSize chunks, which are append-only:
+ * saving a chunk appends a record and the newest record for a chunk wins. A region file's index is rebuilt from
+ * its record headers when it is first opened, so loading chunks near the player only ever reads the regions they
+ * are in, however much of the world has been saved. A region file is rewritten without its superseded records
+ * once they take up most of it.
+ *
+ * Every file access runs in order on one background thread of its own, so that it never waits behind generation
+ * work; loads and saves are called back on the game thread in the subsystem's tick.
+ */
+UCLASS()
+class THIRDPERSON_API UChunkStorage : public UWorldSubsystem, public FTickableGameObject
+{
+  GENERATED_BODY()
+
+public:
+  static constexpr int32 RegionSize = 32;
+
+  /** What was last saved for the chunk, or empty data if nothing was. */
+  using FOnChunkLoaded = TUniqueFunction<void(TArray<uint8> &&Data)>;
+
+  /** Whether the chunk's data was written; if not, what was saved before is kept. */
+  using FOnChunkSaved = TUniqueFunction<void(bool bSaved)>;
+
+  void Initialize(FSubsystemCollectionBase &Collection) override;
+  void Deinitialize() override;
+
+  /** Calls OnLoaded on the game thread with the chunk's data, unless Owner has been destroyed by then. */
+  void Load(FName Channel, FIntVector ChunkAddress, const UObject *Owner, FOnChunkLoaded OnLoaded);
+
+  /**
+   * Saves the chunk's data, replacing what was saved before; saving empty data erases it. Loads queued after this see it.
+   * Calls OnSaved, if given, on the game thread with whether it was written, unless Owner has been destroyed by then.
+   */
+  void Save(FName Channel, FIntVector ChunkAddress, TArray<uint8> Data, const UObject *Owner = nullptr, FOnChunkSaved OnSaved = {});
+
+  /** Erases every chunk's data in Channel. */
+  void ClearChannel(FName Channel);
+
+  /** Blocks until everything queued so far has been done, then delivers what finished on the calling (game) thread. */
+  void Flush();
+
+  /** Where the world's region files are, one directory per channel. */
+  const FString &GetDirectory() const { return Directory; }
+
+  //------------------------------------------------------------------------------
+  // FTickableGameObject
+
+  void Tick(float DeltaTime) override;
+  TStatId GetStatId() const override;
+  bool IsTickableInEditor() const override { return true; }
+  ETickableTickType GetTickableTickType() const override { return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Always; }
+  UWorld *GetTickableGameObjectWorld() const override { return GetWorld(); }
+
+private:
+  class FRegionFile;
+  struct FShared;
+
+  struct FCompletion
+  {
+    TWeakObjectPtr<const UObject> Owner;
+    TUniqueFunction<void()> OnComplete;
+  };
+
+  // calls back finished loads and saves
+  void DeliverCompleted();
+
+  // the worker, started on first use
+  TSharedPtr<FProceduralGenerationPool, ESPMode::ThreadSafe> GetWorker();
+
+  FString Directory;
+  TSharedPtr<FProceduralGenerationPool, ESPMode::ThreadSafe> Worker; // one thread, so file access runs in the order queued; null until used
+  TSharedPtr<FShared, ESPMode::ThreadSafe> Shared;                    // the worker's; open region files and finished loads
+  TArray<FCompletion> Completing;                                     // game thread only; swapped with finished loads and saves every tick
+};
@@ -0,0 +1,102 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "PerlinNoise.h"
+#include "SimplexNoise.h"
+
+// Height sources for terrain generation: small value types, each callable as
+//
+//   NoiseSample operator()(float x, float y) const
+//
+// returning height and its analytic gradient at a location in noise space, roughly within (-1,1).
+// Sources are composed as template arguments rather than through virtual calls, so that code generic over
+// the source, like chunk sampling, is compiled once per source with the whole source inlined into its loop.
+
+namespace noise
+{
+  struct Perlin
+  {
+    FORCEINLINE NoiseSample
+    operator()(const float x, const float y) const
+    {
+      return perlinNoise2D(x, y);
+    }
+  };
+
+  struct Simplex
+  {
+    FORCEINLINE NoiseSample
+    operator()(const float x, const float y) const
+    {
+      return simplexNoise2D(x, y);
+    }
+  };
+
+  // Sharp crests where the source crosses zero: 1 - 2|source|.
+  template<typename Source>
+  struct Ridged
+  {
+    Source source;
+
+    FORCEINLINE NoiseSample
+    operator()(const float x, const float y) const
+    {
+      const NoiseSample sample = source(x, y);
+      const float sign = sample.value < 0.f ? -1.f : 1.f;
+      return {1.f - 2.f * sign * sample.value, sample.gradient * (-2.f * sign)};
+    }
+  };
+
+  // Fractal Brownian motion: octaves of the source at rising frequency and falling amplitude, normalized to the
+  // source's range. Each octave is offset so that their lattices don't line up at the origin.
+  template<typename Source>
+  struct Fbm
+  {
+    Source source;
+    int32 octaves = 4;
+    float lacunarity = 2.f; // frequency multiplier from one octave to the next
+    float gain = 0.5f;      // amplitude multiplier from one octave to the next
+
+    FORCEINLINE NoiseSample
+    operator()(const float x, const float y) const
+    {
+      NoiseSample result{0.f, FVector2D::ZeroVector};
+      float amplitude = 1.f, frequency = 1.f, totalAmplitude = 0.f;
+
+      for (int32 octave = 0; octave < octaves; ++octave)
+      {
+        const float offset = 17.31f * octave;
+        const NoiseSample sample = source(x * frequency + offset, y * frequency + offset);
+        result.value += amplitude * sample.value;
+        result.gradient += (amplitude * frequency) * sample.gradient;
+
+        totalAmplitude += amplitude;
+        amplitude *= gain;
+        frequency *= lacunarity;
+      }
+
+      const float rTotalAmplitude = 1.f / totalAmplitude;
+      result.value *= rTotalAmplitude;
+      result.gradient *= rTotalAmplitude;
+      return result;
+    }
+  };
+
+  // One source over another: a + weight * b.
+  template<typename A, typename B>
+  struct Sum
+  {
+    A a;
+    B b;
+    float weight = 1.f;
+
+    FORCEINLINE NoiseSample
+    operator()(const float x, const float y) const
+    {
+      const NoiseSample sampleA = a(x, y);
+      const NoiseSample sampleB = b(x, y);
+      return {sampleA.value + weight * sampleB.value, sampleA.gradient + weight * sampleB.gradient};
+    }
+  };
+} // namespace noise
@@ -0,0 +1,210 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HeightfieldVirtualTexture.h"
+
+#include "RenderGraphBuilder.h"
+#include "RHICommandList.h"
+
+namespace
+{
+  // a filled page not requested again for this many frames is dropped; the renderer asks again if it still wants it
+  constexpr uint32 StalePageFrames = 60;
+} // namespace
+
+void
+fillHeightfieldPage(
+  const FHeightfieldPageDesc &Desc,
+  const TFunctionRef<float(FVector2D, FVector*)> SampleHeight,
+  const TArrayView<uint16> OutHeights,
+  const TArrayView<FColor> OutNormals)
+{
+  const uint32 pageSize = Desc.GetPageSize();
+  check(uint32(OutHeights.Num()) == pageSize * pageSize);
+  check(OutNormals.IsEmpty() || uint32(OutNormals.Num()) == pageSize * pageSize);
+
+  // level texels are 2^vLevel level 0 texels wide; sample at their centers
+  const float texelScale = float(1u << Desc.vLevel);
+  const FVector2D rTextureSize{1.f / Desc.WidthInTexels, 1.f / Desc.HeightInTexels};
+  const int32 firstX = int32(Desc.TileX * Desc.TileSize) - int32(Desc.TileBorderSize);
+  const int32 firstY = int32(Desc.TileY * Desc.TileSize) - int32(Desc.TileBorderSize);
+
+  const FVector volumeOrigin = Desc.VolumeToWorld.GetLocation();
+  const float rVolumeHeight = 1.f / Desc.VolumeToWorld.GetScale3D().Z;
+
+  for (uint32 y = 0, index = 0; y < pageSize; ++y)
+  {
+    const float v = (float(firstY + int32(y)) + 0.5f) * texelScale * rTextureSize.Y;
+
+    for (uint32 x = 0; x < pageSize; ++x, ++index)
+    {
+      const float u = (float(firstX + int32(x)) + 0.5f) * texelScale * rTextureSize.X;
+      const FVector2D worldLocation{Desc.VolumeToWorld.TransformPosition(FVector{u, v, 0.f})};
+
+      FVector normal;
+      const float height = SampleHeight(worldLocation, OutNormals.IsEmpty() ? nullptr : &normal);
+
+      const float normalizedHeight = FMath::Clamp((height - volumeOrigin.Z) * rVolumeHeight, 0.f, 1.f);
+      OutHeights[index] = uint16(FMath::RoundToInt(normalizedHeight * 65535.f));
+
+      if (!OutNormals.IsEmpty())
+        OutNormals[index] = FColor{
+          uint8(FMath::RoundToInt((normal.X * 0.5f + 0.5f) * 255.f)),
+          uint8(FMath::RoundToInt((normal.Y * 0.5f + 0.5f) * 255.f)),
+          uint8(FMath::RoundToInt((normal.Z * 0.5f + 0.5f) * 255.f)),
+          255};
+    }
+  }
+}
+
+//==============================================================================
+
+FHeightfieldVirtualTextureProducer::FHeightfieldVirtualTextureProducer(
+  const FVTProducerDescription &InDesc, const FTransform &InVolumeToWorld, FHeightfieldSampler InSampler)
+  : Desc{InDesc}
+  , VolumeToWorld{InVolumeToWorld}
+  , Sampler{MoveTemp(InSampler)}
+{
+  check(Desc.NumTextureLayers == 1); // world height only
+}
+
+FHeightfieldVirtualTextureProducer::~FHeightfieldVirtualTextureProducer()
+{
+  // workers reference Sampler and their pages
+  for (const auto &page : Pages)
+    page.Value->Task.Wait();
+}
+
+FHeightfieldPageDesc FHeightfieldVirtualTextureProducer::getPageDesc(const uint8 vLevel, const uint64 vAddress) const
+{
+  FHeightfieldPageDesc pageDesc;
+  pageDesc.VolumeToWorld = VolumeToWorld;
+  pageDesc.WidthInTexels = Desc.BlockWidthInTiles * Desc.WidthInBlocks * Desc.TileSize;
+  pageDesc.HeightInTexels = Desc.BlockHeightInTiles * Desc.HeightInBlocks * Desc.TileSize;
+  pageDesc.TileSize = Desc.TileSize;
+  pageDesc.TileBorderSize = Desc.TileBorderSize;
+  pageDesc.vLevel = vLevel;
+  pageDesc.TileX = uint32(FMath::ReverseMortonCode2_64(vAddress));
+  pageDesc.TileY = uint32(FMath::ReverseMortonCode2_64(vAddress >> 1));
+  return pageDesc;
+}
+
+FVTRequestPageResult FHeightfieldVirtualTextureProducer::RequestPageData(
+  const FVirtualTextureProducerHandle &ProducerHandle, const uint8 LayerMask, const uint8 vLevel, const uint64 vAddress,
+  EVTRequestPagePriority Priority)
+{
+  const uint64 key = (vAddress << 4) | vLevel;
+
+  evictStalePages();
+
+  if (const TSharedPtr<Page> *page = Pages.Find(key))
+  {
+    (*page)->LastRequestedFrame = GFrameNumberRenderThread;
+
+    if (!(*page)->Task.IsCompleted())
+      return {EVTRequestPageStatus::Pending, key};
+    if (!(*page)->bOutdated)
+      return {EVTRequestPageStatus::Available, key};
+    // outdated and no longer being written to: filled again below
+  }
+
+  fillPage(key, getPageDesc(vLevel, vAddress), Priority);
+  return {EVTRequestPageStatus::Pending, key};
+}
+
+void FHeightfieldVirtualTextureProducer::fillPage(const uint64 Key, const FHeightfieldPageDesc &PageDesc, const EVTRequestPagePriority Priority)
+{
+  const uint32 pageSize = PageDesc.GetPageSize();
+
+  const TSharedPtr<Page> page = MakeShared<Page>();
+  page->Heights.SetNumUninitialized(pageSize * pageSize);
+  page->PageDesc = PageDesc;
+  page->LastRequestedFrame = GFrameNumberRenderThread;
+
+  // level texels are 2^vLevel level 0 texels wide
+  const FVector2D texelSize = FVector2D{float(1u << PageDesc.vLevel) / PageDesc.WidthInTexels, float(1u << PageDesc.vLevel) / PageDesc.HeightInTexels};
+  const FVector2D firstTexel{float(PageDesc.TileX * PageDesc.TileSize) - PageDesc.TileBorderSize, float(PageDesc.TileY * PageDesc.TileSize) - PageDesc.TileBorderSize};
+  page->UVBounds = FBox2D{firstTexel * texelSize, (firstTexel + FVector2D{float(pageSize), float(pageSize)}) * texelSize};
+
+  // the page is only touched by its worker until the task completes
+  page->Task = UE::Tasks::Launch(UE_SOURCE_LOCATION,
+    [this, PageDesc, heights = page->Heights.GetData(), numHeights = page->Heights.Num()]
+    {
+      fillHeightfieldPage(PageDesc, Sampler, TArrayView<uint16>{heights, numHeights}, {});
+    },
+    Priority == EVTRequestPagePriority::High ? UE::Tasks::ETaskPriority::High : UE::Tasks::ETaskPriority::BackgroundNormal);
+
+  Pages.Add(Key, page);
+}
+
+void FHeightfieldVirtualTextureProducer::Invalidate(const FVector2D UVMin, const FVector2D UVMax)
+{
+  const FBox2D invalidated{UVMin, UVMax};
+
+  // pages still being filled can't be dropped, their workers write into them; they are marked instead
+  for (auto it = Pages.CreateIterator(); it; ++it)
+    if (it.Value()->UVBounds.Intersect(invalidated))
+    {
+      if (it.Value()->Task.IsCompleted())
+        it.RemoveCurrent();
+      else
+        it.Value()->bOutdated = true;
+    }
+}
+
+void FHeightfieldVirtualTextureProducer::evictStalePages()
+{
+  // once a frame is plenty
+  if (LastEvictionFrame == GFrameNumberRenderThread)
+    return;
+  LastEvictionFrame = GFrameNumberRenderThread;
+
+  // pages still being filled are kept, their workers write into them
+  for (auto it = Pages.CreateIterator(); it; ++it)
+    if (GFrameNumberRenderThread - it.Value()->LastRequestedFrame > StalePageFrames && it.Value()->Task.IsCompleted())
+      it.RemoveCurrent();
+}
+
+IVirtualTextureFinalizer *FHeightfieldVirtualTextureProducer::ProducePageData(
+  FRHICommandListImmediate &RHICmdList, ERHIFeatureLevel::Type FeatureLevel, EVTProducePageFlags Flags,
+  const FVirtualTextureProducerHandle &ProducerHandle, const uint8 LayerMask, const uint8 vLevel, const uint64 vAddress,
+  const uint64 RequestHandle, const FVTProduceTargetLayer *TargetLayers)
+{
+  TSharedPtr<Page> page;
+  if (!Pages.RemoveAndCopyValue(RequestHandle, page))
+    return nullptr;
+
+  page->Task.Wait(); // already complete unless the renderer is forcing the page in
+
+  // requested before the heights under it changed; rare enough to fill again right here rather than upload old heights
+  if (page->bOutdated)
+    fillHeightfieldPage(page->PageDesc, Sampler, page->Heights, {});
+
+  if (LayerMask & 1)
+    Uploads.Add({MoveTemp(page->Heights), TargetLayers[0].TextureRHI, TargetLayers[0].pPageLocation});
+
+  return this;
+}
+
+void FHeightfieldVirtualTextureProducer::Finalize(FRDGBuilder &GraphBuilder)
+{
+  if (Uploads.IsEmpty())
+    return;
+
+  const uint32 pageSize = Desc.TileSize + 2 * Desc.TileBorderSize;
+
+  GraphBuilder.AddPass(RDG_EVENT_NAME("HeightfieldVirtualTextureUpload"), ERDGPassFlags::None,
+    [uploads = MoveTemp(Uploads), pageSize](FRHICommandListImmediate &RHICmdList)
+    {
+      for (const Upload &upload : uploads)
+      {
+        const FUpdateTextureRegion2D region{
+          uint32(upload.PageLocation.X) * pageSize, uint32(upload.PageLocation.Y) * pageSize, 0, 0, pageSize, pageSize};
+        RHICmdList.UpdateTexture2D(
+          static_cast<FRHITexture2D*>(upload.Texture), 0, region, pageSize * sizeof(uint16),
+          reinterpret_cast<const uint8*>(upload.Heights.GetData()));
+      }
+    });
+
+  Uploads.Reset();
+}
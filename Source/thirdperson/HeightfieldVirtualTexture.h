@@ -0,0 +1,117 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tasks/Task.h"
+#include "VirtualTexturing.h"
+
+// Fills runtime virtual texture pages with terrain height on worker threads, straight from a height function,
+// so that nothing has to be rasterized into the virtual texture to get the height back out of it.
+//
+// The page fill is a plain function of the page's placement and a height function, with no rendering involved;
+// the producer only schedules it and uploads its output.
+
+/** Where one page lies in the virtual texture and how the texture maps to the world. */
+struct FHeightfieldPageDesc
+{
+  FTransform VolumeToWorld;   // the virtual texture covers the unit cube of this transform; Z maps height to [0,1]
+  uint32 WidthInTexels = 0;   // size of the whole virtual texture at level 0
+  uint32 HeightInTexels = 0;
+  uint32 TileSize = 0;        // texels per tile side, without borders
+  uint32 TileBorderSize = 0;
+  uint8 vLevel = 0;           // mip level of the page
+  uint32 TileX = 0, TileY = 0; // tile coordinates at vLevel
+
+  uint32 GetPageSize() const { return TileSize + 2 * TileBorderSize; }
+};
+
+/** World height at a location, and optionally the surface normal there. Called concurrently from worker threads. */
+using FHeightfieldSampler = TFunction<float(FVector2D WorldLocation, FVector *OutNormal)>;
+
+/**
+ * Fills one page, row-major, GetPageSize() texels a side, borders included.
+ * Heights are encoded the way world height virtual textures store them: unorm16 over the volume's Z range.
+ * Normals, if OutNormals is not empty, are packed as 8-bit X, Y, Z in the color channels R, G, B.
+ */
+void
+fillHeightfieldPage(
+  const FHeightfieldPageDesc &Desc,
+  TFunctionRef<float(FVector2D, FVector*)> SampleHeight,
+  TArrayView<uint16> OutHeights,
+  TArrayView<FColor> OutNormals);
+
+/**
+ * Streaming producer for a world height runtime virtual texture: each requested page is filled on a worker
+ * by fillHeightfieldPage and reported pending until it is ready, then uploaded when the renderer asks for it.
+ * Owned by the virtual texture system once registered; it waits for its workers when destroyed.
+ */
+class FHeightfieldVirtualTextureProducer final : public IVirtualTexture, public IVirtualTextureFinalizer
+{
+public:
+  FHeightfieldVirtualTextureProducer(const FVTProducerDescription &InDesc, const FTransform &InVolumeToWorld, FHeightfieldSampler InSampler);
+  ~FHeightfieldVirtualTextureProducer() override;
+
+  //------------------------------------------------------------------------------
+  // IVirtualTexture
+
+  bool IsPageStreamed(uint8 vLevel, uint32 vAddress) const override { return true; }
+
+  FVTRequestPageResult RequestPageData(
+    const FVirtualTextureProducerHandle &ProducerHandle, uint8 LayerMask, uint8 vLevel, uint64 vAddress,
+    EVTRequestPagePriority Priority) override;
+
+  IVirtualTextureFinalizer *ProducePageData(
+    FRHICommandListImmediate &RHICmdList, ERHIFeatureLevel::Type FeatureLevel, EVTProducePageFlags Flags,
+    const FVirtualTextureProducerHandle &ProducerHandle, uint8 LayerMask, uint8 vLevel, uint64 vAddress,
+    uint64 RequestHandle, const FVTProduceTargetLayer *TargetLayers) override;
+
+  //------------------------------------------------------------------------------
+  // IVirtualTextureFinalizer
+
+  void Finalize(FRDGBuilder &GraphBuilder) override;
+
+  //------------------------------------------------------------------------------
+
+  /**
+   * Heights changed over [UVMin, UVMax] of the virtual texture: pages over it that were filled, or are being
+   * filled, are filled again before they are reported available. Render thread only; pair it with flushing the
+   * virtual texture's cache over the same area.
+   */
+  void Invalidate(FVector2D UVMin, FVector2D UVMax);
+
+private:
+  struct Page
+  {
+    TArray<uint16> Heights;
+    UE::Tasks::FTask Task;
+    FHeightfieldPageDesc PageDesc;
+    FBox2D UVBounds;           // borders included
+    uint32 LastRequestedFrame = 0;
+    bool bOutdated = false;    // heights changed under it since it started filling
+  };
+
+  struct Upload
+  {
+    TArray<uint16> Heights;
+    FRHITexture *Texture;
+    FIntVector PageLocation;
+  };
+
+  FHeightfieldPageDesc getPageDesc(uint8 vLevel, uint64 vAddress) const;
+
+  // drops filled pages the renderer stopped asking for, which it never produces
+  void evictStalePages();
+
+  // starts filling a new page for the key
+  void fillPage(uint64 Key, const FHeightfieldPageDesc &PageDesc, EVTRequestPagePriority Priority);
+
+  FVTProducerDescription Desc;
+  FTransform VolumeToWorld;
+  FHeightfieldSampler Sampler;
+
+  // render thread only
+  TMap<uint64, TSharedPtr<Page>> Pages; // keyed by vLevel and vAddress, while being filled or waiting for upload
+  TArray<Upload> Uploads;               // produced this frame, uploaded in Finalize
+  uint32 LastEvictionFrame = 0;
+};
@@ -3,6 +3,13 @@
 
 #include "MyGameStateBase.h"
 
+#include "ChunkStorage.h"
+
+namespace
+{
+  const FName gameplayStateChannel{TEXT("GameplayState")};
+}
+
 AMyGameStateBase::AMyGameStateBase()
 {
   UE_LOG(LogTemp, Warning, TEXT("AMyGameStateBase::AMyGameStateBase()"));
@@ -24,5 +31,16 @@ void
 AMyGameStateBase::LoadGameChunk(FIntVector chunkAddress)
 {
   UE_LOG(LogTemp, Warning, TEXT("AMyGameStateBase::LoadGameChunk(..): {%d, %d, %d}"), chunkAddress.X, chunkAddress.Y, chunkAddress.Z);
+
+  if( UChunkStorage *storage = GetWorld()->GetSubsystem<UChunkStorage>() )
+    storage->Load(gameplayStateChannel, chunkAddress, this,
+      [this, chunkAddress](TArray<uint8> &&gameplayState) { OnGameChunkLoaded(chunkAddress, gameplayState); });
+}
+
+void
+AMyGameStateBase::SaveGameChunk(FIntVector chunkAddress, const TArray<uint8>& gameplayState)
+{
+  if( UChunkStorage *storage = GetWorld()->GetSubsystem<UChunkStorage>() )
+    storage->Save(gameplayStateChannel, chunkAddress, gameplayState);
 }
 
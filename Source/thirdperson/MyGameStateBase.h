@@ -24,7 +24,16 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void TestFunction();
 
+	/** Loads the chunk's saved gameplay state from the world's chunk storage, then calls OnGameChunkLoaded. */
 	UFUNCTION(BlueprintCallable)
 	void LoadGameChunk(FIntVector chunkAddress);
+
+	/** Saves the chunk's gameplay state, replacing what was saved before; saving an empty state erases it. */
+	UFUNCTION(BlueprintCallable)
+	void SaveGameChunk(FIntVector chunkAddress, const TArray<uint8>& gameplayState);
+
+	/** The chunk's saved gameplay state, empty if none was saved. */
+	UFUNCTION(BlueprintImplementableEvent)
+	void OnGameChunkLoaded(FIntVector chunkAddress, const TArray<uint8>& gameplayState);
 	
 };
@@ -0,0 +1,96 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// 2D Perlin gradient noise that returns its analytic gradient along with its value, so that
+// surface normals and tangents can be computed from the same sample instead of from neighboring samples.
+//
+// Same construction as FMath::PerlinNoise2D (quintic fade, 8 gradient directions, result in (-1,1))
+// but with Ken Perlin's reference permutation, since the engine's table is private.
+
+namespace noise
+{
+  struct NoiseSample
+  {
+    float value;
+    FVector2D gradient; // d(value)/dx, d(value)/dy
+  };
+
+  inline constexpr uint8 perlinPermutation[256] =
+  {
+    151, 160, 137,  91,  90,  15, 131,  13, 201,  95,  96,  53, 194, 233,   7, 225,
+    140,  36, 103,  30,  69, 142,   8,  99,  37, 240,  21,  10,  23, 190,   6, 148,
+    247, 120, 234,  75,   0,  26, 197,  62,  94, 252, 219, 203, 117,  35,  11,  32,
+     57, 177,  33,  88, 237, 149,  56,  87, 174,  20, 125, 136, 171, 168,  68, 175,
+     74, 165,  71, 134, 139,  48,  27, 166,  77, 146, 158, 231,  83, 111, 229, 122,
+     60, 211, 133, 230, 220, 105,  92,  41,  55,  46, 245,  40, 244, 102, 143,  54,
+     65,  25,  63, 161,   1, 216,  80,  73, 209,  76, 132, 187, 208,  89,  18, 169,
+    200, 196, 135, 130, 116, 188, 159,  86, 164, 100, 109, 198, 173, 186,   3,  64,
+     52, 217, 226, 250, 124, 123,   5, 202,  38, 147, 118, 126, 255,  82,  85, 212,
+    207, 206,  59, 227,  47,  16,  58,  17, 182, 189,  28,  42, 223, 183, 170, 213,
+    119, 248, 152,   2,  44, 154, 163,  70, 221, 153, 101, 155, 167,  43, 172,   9,
+    129,  22,  39, 253,  19,  98, 108, 110,  79, 113, 224, 232, 178, 185, 112, 104,
+    218, 246,  97, 228, 251,  34, 242, 193, 238, 210, 144,  12, 191, 179, 162, 241,
+     81,  51, 145, 235, 249,  14, 239, 107,  49, 192, 214,  31, 181, 199, 106, 157,
+    184,  84, 204, 176, 115, 121,  50,  45, 127,   4, 150, 254, 138, 236, 205,  93,
+    222, 114,  67,  29,  24,  72, 243, 141, 128, 195,  78,  66, 215,  61, 156, 180,
+  };
+
+  // corners and major axes, matching the engine's Grad2()
+  inline constexpr float perlinGradientX[8] = {1.f, 1.f, 0.f, -1.f, -1.f, -1.f, 0.f, 1.f};
+  inline constexpr float perlinGradientY[8] = {0.f, 1.f, 1.f, 1.f, 0.f, -1.f, -1.f, -1.f};
+
+  FORCEINLINE int32
+  perlinHash(const int32 x, const int32 y)
+  {
+    return perlinPermutation[(perlinPermutation[x & 255] + y) & 255] & 7;
+  }
+
+  FORCEINLINE NoiseSample
+  perlinNoise2D(const float x, const float y)
+  {
+    const float xFloor = FMath::FloorToFloat(x);
+    const float yFloor = FMath::FloorToFloat(y);
+    const int32 xi = int32(xFloor);
+    const int32 yi = int32(yFloor);
+    const float fx = x - xFloor;
+    const float fy = y - yFloor;
+
+    const int32 h00 = perlinHash(xi, yi);
+    const int32 h10 = perlinHash(xi + 1, yi);
+    const int32 h01 = perlinHash(xi, yi + 1);
+    const int32 h11 = perlinHash(xi + 1, yi + 1);
+
+    const float gx00 = perlinGradientX[h00], gy00 = perlinGradientY[h00];
+    const float gx10 = perlinGradientX[h10], gy10 = perlinGradientY[h10];
+    const float gx01 = perlinGradientX[h01], gy01 = perlinGradientY[h01];
+    const float gx11 = perlinGradientX[h11], gy11 = perlinGradientY[h11];
+
+    // corner contributions
+    const float n00 = gx00 * fx + gy00 * fy;
+    const float n10 = gx10 * (fx - 1.f) + gy10 * fy;
+    const float n01 = gx01 * fx + gy01 * (fy - 1.f);
+    const float n11 = gx11 * (fx - 1.f) + gy11 * (fy - 1.f);
+
+    // quintic fade and its derivative
+    const float u = fx * fx * fx * (fx * (fx * 6.f - 15.f) + 10.f);
+    const float v = fy * fy * fy * (fy * (fy * 6.f - 15.f) + 10.f);
+    const float du = 30.f * fx * fx * (fx - 1.f) * (fx - 1.f);
+    const float dv = 30.f * fy * fy * (fy - 1.f) * (fy - 1.f);
+
+    // bilinear blend written so that its partial derivatives fall out directly
+    const float kx = n10 - n00;
+    const float ky = n01 - n00;
+    const float kxy = n00 - n10 - n01 + n11;
+
+    NoiseSample sample;
+    sample.value = n00 + u * kx + v * ky + u * v * kxy;
+    sample.gradient.X =
+      gx00 + u * (gx10 - gx00) + v * (gx01 - gx00) + u * v * (gx00 - gx10 - gx01 + gx11) + du * (kx + v * kxy);
+    sample.gradient.Y =
+      gy00 + u * (gy10 - gy00) + v * (gy01 - gy00) + u * v * (gy00 - gy10 - gy01 + gy11) + dv * (ky + u * kxy);
+    return sample;
+  }
+} // namespace noise
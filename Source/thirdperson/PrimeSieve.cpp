@@ -0,0 +1,247 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PrimeSieve.h"
+
+#include "Tasks/Task.h"
+
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+  // the residues mod 30 that a byte's bits stand for, in bit order
+  constexpr uint8 wheel[8]{1, 7, 11, 13, 17, 19, 23, 29};
+
+  // bit of a residue mod 30 that is coprime to 30; the others have no bit
+  constexpr int8 bitOfResidue[30]{
+    -1, 0, -1, -1, -1, -1, -1, 1, -1, -1, -1, 2, -1, 3, -1, -1, -1, 4, -1, 5, -1, -1, -1, 6, -1, -1, -1, -1, -1, 7};
+
+  // primes from 7 whose squares are below limit: those that cross off the rest
+  std::vector<uint32>
+  findSievingPrimes(const uint64 limit)
+  {
+    uint64 root = uint64(std::sqrt(double(limit)));
+    while (root > 0 && root * root >= limit)
+      --root;
+    while ((root + 1) * (root + 1) < limit)
+      ++root;
+
+    std::vector<bool> composite(root + 1);
+    std::vector<uint32> sievingPrimes;
+
+    for (uint64 i = 2; i <= root; ++i)
+    {
+      if (composite[i])
+        continue;
+
+      if (i >= 7)
+        sievingPrimes.push_back(uint32(i));
+
+      for (uint64 j = i * i; j <= root; j += i)
+        composite[j] = true;
+    }
+
+    return sievingPrimes;
+  }
+
+  // Sieves the numbers coprime to 30 in [30 * firstByte, 30 * (firstByte + numBytes)), below limit, into bits.
+  void
+  sieveSegment(
+    std::vector<uint8> &bits, const uint64 firstByte, const int32 numBytes,
+    const std::vector<uint32> &sievingPrimes, const uint64 limit)
+  {
+    bits.assign(numBytes, 0xff);
+
+    const uint64 low = 30 * firstByte;
+    const uint64 high = low + 30 * uint64(numBytes);
+
+    for (const uint32 p : sievingPrimes)
+    {
+      if (uint64(p) * p >= high)
+        break;
+
+      // multiples p * k with k coprime to 30 are the only ones with bits; for each residue of k they are 30p apart,
+      // which is p bytes, and all fall on the same bit
+      const uint64 kMin = FMath::Max<uint64>(p, (low + p - 1) / p);
+
+      for (const uint8 residue : wheel)
+      {
+        const uint64 k = kMin + (residue + 30 - kMin % 30) % 30;
+        const uint64 multiple = uint64(p) * k;
+        if (multiple >= high)
+          continue;
+
+        const uint8 mask = uint8(~(1u << bitOfResidue[multiple % 30]));
+        for (uint64 i = multiple / 30 - firstByte; i < uint64(numBytes); i += p)
+          bits[i] &= mask;
+      }
+    }
+
+    if (firstByte == 0)
+      bits[0] &= ~1u; // 1 is not prime
+
+    // only the last byte of the range can reach past limit
+    if (high > limit)
+      for (int32 bit = 0; bit < 8; ++bit)
+        if (high - 30 + wheel[bit] >= limit)
+          bits[numBytes - 1] &= uint8(~(1u << bit));
+  }
+
+  int32
+  countBits(const std::vector<uint8> &bits)
+  {
+    int32 count = 0;
+    for (const uint8 byte : bits)
+      count += FMath::CountBits(byte);
+    return count;
+  }
+
+  struct Sieve
+  {
+    uint64 limit;
+    int32 segmentBytes;
+    uint64 numBytes;
+    std::vector<uint32> sievingPrimes;
+    std::vector<uint32> segmentCounts; // primes coprime to 30 in each segment
+
+    Sieve(const uint64 limit, const int32 segmentBytes)
+      : limit{limit}
+      , segmentBytes{FMath::Max(1, segmentBytes)}
+      , numBytes{(limit + 29) / 30}
+      , sievingPrimes{findSievingPrimes(limit)}
+      , segmentCounts((numBytes + this->segmentBytes - 1) / this->segmentBytes)
+    {}
+
+    void
+    sieve(std::vector<uint8> &bits, const uint64 segment) const
+    {
+      const uint64 firstByte = segment * segmentBytes;
+      sieveSegment(bits, firstByte, int32(FMath::Min<uint64>(segmentBytes, numBytes - firstByte)), sievingPrimes, limit);
+    }
+
+    // counts every segment, numThreads tasks taking the next one left until all are done; false if progress stopped it
+    bool
+    countSegments(const int32 numThreads, const primes::SieveProgress &progress)
+    {
+      std::atomic<uint64> nextSegment{0};
+      std::atomic<uint64> segmentsDone{0};
+      std::atomic<bool> stopped{false};
+
+      auto work = [&]
+      {
+        std::vector<uint8> bits;
+        for (uint64 segment; !stopped && (segment = nextSegment++) < segmentCounts.size();)
+        {
+          sieve(bits, segment);
+          segmentCounts[segment] = countBits(bits);
+
+          if (progress && !progress(float(++segmentsDone) / segmentCounts.size()))
+            stopped = true;
+        }
+      };
+
+      // the calling thread is one of them
+      TArray<UE::Tasks::FTask> tasks;
+      for (int32 i = 1; i < numThreads; ++i)
+        tasks.Add(UE::Tasks::Launch(UE_SOURCE_LOCATION, work, UE::Tasks::ETaskPriority::BackgroundNormal));
+
+      work();
+      UE::Tasks::Wait(tasks);
+
+      return !stopped;
+    }
+  };
+
+  // 2, 3 and 5 have no bits in the wheel
+  constexpr uint64 wheelPrimes[3]{2, 3, 5};
+} // namespace
+
+//==============================================================================
+
+uint64
+primes::nthPrimeUpperBound(const uint64 n)
+{
+  if (n < 6)
+    return 13;
+
+  // Rosser's theorem: p(n) < n (ln n + ln ln n) for n >= 6
+  const double logN = std::log(double(n));
+  return uint64(double(n) * (logN + std::log(logN))) + 1;
+}
+
+primes::SieveResult
+primes::countPrimes(const uint64 limit, const int32 numThreads, const SieveProgress &progress, const int32 segmentBytes)
+{
+  SieveResult result;
+  result.limit = limit;
+  result.numThreads = FMath::Max(1, numThreads);
+
+  const double startSeconds = FPlatformTime::Seconds();
+
+  Sieve sieve{limit, segmentBytes};
+  result.cancelled = !sieve.countSegments(result.numThreads, progress);
+
+  for (const uint64 p : wheelPrimes)
+    result.count += p < limit;
+  for (const uint32 segmentCount : sieve.segmentCounts)
+    result.count += segmentCount;
+
+  result.seconds = FPlatformTime::Seconds() - startSeconds;
+  return result;
+}
+
+primes::SieveResult
+primes::findNthPrime(const uint64 n, const int32 numThreads, const SieveProgress &progress, const int32 segmentBytes)
+{
+  SieveResult result;
+  result.numThreads = FMath::Max(1, numThreads);
+
+  if (n == 0)
+    return result;
+
+  if (n <= 3)
+  {
+    result.limit = wheelPrimes[n - 1] + 1;
+    result.count = n;
+    result.nthPrime = wheelPrimes[n - 1];
+    return result;
+  }
+
+  const double startSeconds = FPlatformTime::Seconds();
+
+  result.limit = nthPrimeUpperBound(n) + 1;
+  Sieve sieve{result.limit, segmentBytes};
+  result.cancelled = !sieve.countSegments(result.numThreads, progress);
+
+  result.count = 3;
+  for (const uint32 segmentCount : sieve.segmentCounts)
+    result.count += segmentCount;
+
+  if (result.cancelled)
+  {
+    result.seconds = FPlatformTime::Seconds() - startSeconds;
+    return result;
+  }
+
+  // find the segment it falls in, then sieve that one again to walk its primes in order
+  uint64 remaining = n - 3;
+  uint64 segment = 0;
+  while (sieve.segmentCounts[segment] < remaining)
+    remaining -= sieve.segmentCounts[segment++];
+
+  std::vector<uint8> bits;
+  sieve.sieve(bits, segment);
+
+  for (uint64 i = 0; i < bits.size() && !result.nthPrime; ++i)
+    for (int32 bit = 0; bit < 8; ++bit)
+      if ((bits[i] >> bit & 1) && --remaining == 0)
+      {
+        result.nthPrime = 30 * (segment * sieve.segmentBytes + i) + wheel[bit];
+        break;
+      }
+
+  result.seconds = FPlatformTime::Seconds() - startSeconds;
+  return result;
+}
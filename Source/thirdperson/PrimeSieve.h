@@ -0,0 +1,42 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Segmented sieve of Eratosthenes over a mod-30 wheel, for exercising every core with real work.
+//
+// Only numbers coprime to 30 are stored, eight to a byte, so multiples of 2, 3 and 5 cost neither memory nor time.
+// The range is cut into segments small enough to stay in cache while they are sieved; tasks take segments
+// from a shared counter until none are left, so faster workers simply sieve more of them. The tasks run on the
+// engine's task workers, so a sieve adds no threads of its own and can be started from any thread.
+
+namespace primes
+{
+  constexpr int32 defaultSegmentBytes = 32 * 1024; // typical L1 data cache; each byte covers 30 numbers
+
+  struct SieveResult
+  {
+    uint64 limit{};    // primes below limit were sieved
+    uint64 count{};    // how many there are
+    uint64 nthPrime{}; // the prime asked for by findNthPrime, otherwise 0
+    int32 numThreads{};
+    double seconds{};
+    bool cancelled{}; // stopped by its progress callback, in which case count and nthPrime are incomplete
+  };
+
+  /** Called after each segment, from whichever thread sieved it, with the fraction done; false stops the sieve. */
+  using SieveProgress = TFunction<bool(float fractionDone)>;
+
+  /** At least the nth prime (counting 2 as the first), so that sieving below it finds n primes or more. */
+  uint64
+  nthPrimeUpperBound(uint64 n);
+
+  /** Counts the primes below limit on up to numThreads threads, the calling one included. */
+  SieveResult
+  countPrimes(uint64 limit, int32 numThreads, const SieveProgress &progress = {}, int32 segmentBytes = defaultSegmentBytes);
+
+  /** Finds the nth prime (counting 2 as the first) on up to numThreads threads, the calling one included. */
+  SieveResult
+  findNthPrime(uint64 n, int32 numThreads, const SieveProgress &progress = {}, int32 segmentBytes = defaultSegmentBytes);
+} // namespace primes
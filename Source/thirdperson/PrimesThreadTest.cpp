@@ -3,101 +3,200 @@
 
 #include "PrimesThreadTest.h"
 
+#include "PrimeSieve.h"
+
 namespace
 {
-	class PrimeSearchTask : public FNonAbandonableTask
+	// Returns the numPrimesToFind'th prime, or 0 if cancelled first; context may be null.
+	int64 findNthPrimeByTrialDivision(int32 numPrimesToFind, FAsyncJobContext *context = nullptr)
 	{
-		int32 numPrimesToFind;
-		TSharedPtr< std::atomic_bool > busyFindingPrimes;
-
-	public:
-		PrimeSearchTask(int32 numPrimesToFind, TSharedPtr< std::atomic_bool > busyFindingPrimes = {})
-			: numPrimesToFind{ numPrimesToFind }
-			, busyFindingPrimes{ std::move( busyFindingPrimes )}
-		{}
+		int32 numPrimesFound = 0;
+		int32 currentTestNumber = 2;
 
-		~PrimeSearchTask()
+		while (numPrimesFound < numPrimesToFind)
 		{
-			UE_LOG(LogTemp, Warning, TEXT("Finished searching for primes!"));
-			if( busyFindingPrimes )
-				*busyFindingPrimes = false;
+			bool isPrime = true;
+
+			for (int32 i = 2; i <= currentTestNumber / 2; ++i)
+				if (currentTestNumber % i == 0)
+				{
+					isPrime = false;
+					break;
+				}
+
+			if (isPrime)
+			{
+				++numPrimesFound;
+
+				if (context && numPrimesFound % 100 == 0)
+				{
+					if (context->IsCancelRequested())
+						return 0;
+					context->SetProgress(float(numPrimesFound) / numPrimesToFind);
+				}
+			}
+
+			++currentTestNumber;
 		}
 
+		return currentTestNumber - 1;
+	}
 
-		// required by UE, ***must have***
-		FORCEINLINE TStatId GetStatId() const
+	// Reports a sieve's progress to the job as the stretch [firstFraction, firstFraction + fractions) of it, and stops
+	// the sieve once the job is cancelled.
+	primes::SieveProgress sieveProgress(FAsyncJobContext &context, float firstFraction = 0.f, float fractions = 1.f)
+	{
+		return [&context, firstFraction, fractions](float fractionDone)
 		{
-			RETURN_QUICK_DECLARE_CYCLE_STAT(PrimeSearchTask, STATGROUP_ThreadPoolAsyncTasks);
-		}
+			context.SetProgress(firstFraction + fractionDone * fractions);
+			return !context.IsCancelRequested();
+		};
+	}
+
+	// Finds the same prime with the sieve on more and more threads, to see how it scales with cores.
+	int64 findNthPrimeBySieveScaling(int32 numPrimesToFind, int32 maxThreads, FAsyncJobContext &context)
+	{
+		int32 numRuns = 1;
+		for (int32 numThreads = 1; numThreads < maxThreads; numThreads = FMath::Min(numThreads * 2, maxThreads))
+			++numRuns;
+
+		double oneThreadSeconds = 0.0;
+		int64 prime = 0;
 
-		void DoWork()
+		for (int32 numThreads = 1, run = 0;; numThreads = FMath::Min(numThreads * 2, maxThreads))
 		{
-			int32 numPrimesFound = 0;
-			int32 currentTestNumber = 2;
+			const primes::SieveResult result =
+				primes::findNthPrime(numPrimesToFind, numThreads, sieveProgress(context, float(run) / numRuns, 1.f / numRuns));
+			if (result.cancelled)
+				return 0;
 
-			while (numPrimesFound < numPrimesToFind)
-			{
-				bool isPrime = true;
+			const double seconds = FMath::Max(result.seconds, 1e-6);
+			prime = result.nthPrime;
 
-				for (int32 i = 2; i < currentTestNumber / 2; ++i)
-					if (currentTestNumber % i == 0)
-					{
-						isPrime = false;
-						break;
-					}
+			if (numThreads == 1)
+				oneThreadSeconds = seconds;
 
-				if (isPrime)
-				{
-					numPrimesFound += isPrime;
+			UE_LOG(LogTemp, Warning,
+				TEXT("Prime sieve: prime %d is %llu; %llu primes below %llu on %d threads in %.3f s (%.0f primes/s), %.2fx one thread"),
+				numPrimesToFind, result.nthPrime, result.count, result.limit, numThreads, seconds,
+				result.count / seconds, oneThreadSeconds / seconds);
 
-					if (numPrimesFound % 1000 == 0)
-						UE_LOG(LogTemp, Warning, TEXT("Primes found: %i"), numPrimesFound);
-				}
+			context.SetProgress(float(++run) / numRuns);
 
-				++currentTestNumber;
-			}
+			if (numThreads >= maxThreads || context.IsCancelRequested())
+				break;
 		}
-	};
+
+		return prime;
+	}
 } // namespace
 
+//==============================================================================
+
+UFindPrimeAsyncJob *UFindPrimeAsyncJob::FindPrimeAsync(
+	UObject *WorldContextObject, int32 NumPrimesToFind, EPrimeSearchMethod Method, int32 MaxThreads, float Priority)
+{
+	UFindPrimeAsyncJob *job = NewObject<UFindPrimeAsyncJob>();
+	job->NumPrimesToFind = NumPrimesToFind;
+	job->Method = Method;
+	job->MaxThreads = MaxThreads > 0 ? MaxThreads : FPlatformMisc::NumberOfCoresIncludingHyperthreads();
+	job->Priority = Priority;
+	job->InitJob(WorldContextObject);
+	return job;
+}
+
+void UFindPrimeAsyncJob::Activate()
+{
+	StartJob<int64>(Priority,
+		[numPrimesToFind = NumPrimesToFind, method = Method, maxThreads = MaxThreads](FAsyncJobContext &context) -> int64
+		{
+			if (numPrimesToFind <= 0)
+				return 0;
+
+			switch (method)
+			{
+			case EPrimeSearchMethod::Sieve:
+				return primes::findNthPrime(numPrimesToFind, maxThreads, sieveProgress(context)).nthPrime;
+			case EPrimeSearchMethod::SieveScaling:
+				return findNthPrimeBySieveScaling(numPrimesToFind, maxThreads, context);
+			default:
+				return findNthPrimeByTrialDivision(numPrimesToFind, &context);
+			}
+		},
+		[this](int64 &&prime)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Finished searching for primes! Prime %d is %lld"), NumPrimesToFind, prime);
+			OnFound.Broadcast(prime);
+		});
+}
+
+void UFindPrimeAsyncJob::OnJobCancelled()
+{
+	UE_LOG(LogTemp, Warning, TEXT("Cancelled searching for primes"));
+	OnCancelled.Broadcast();
+}
+
+//==============================================================================
+
 // Sets default values
 APrimesThreadTest::APrimesThreadTest()
 {
- 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+	// background searches report back through their job, so there is nothing to poll every frame
+	PrimaryActorTick.bCanEverTick = false;
+}
 
+void APrimesThreadTest::RunPrimeTaskOnBackgroundThread(int32 numPrimesToFind)
+{
+	StartPrimeJob(numPrimesToFind, EPrimeSearchMethod::TrialDivision);
 }
 
-// Called when the game starts or when spawned
-void APrimesThreadTest::BeginPlay()
+void APrimesThreadTest::RunPrimeTaskOnMainThread(int32 numPrimesToFind)
 {
-	Super::BeginPlay();
+	findNthPrimeByTrialDivision(numPrimesToFind);
+	UE_LOG(LogTemp, Warning, TEXT("Finished searching for primes!"));
+	OnDoneFindingPrimes();
+}
+
+void APrimesThreadTest::RunPrimeSieveScalingOnBackgroundThread(int32 numPrimesToFind, int32 maxThreads)
+{
+	StartPrimeJob(numPrimesToFind, EPrimeSearchMethod::SieveScaling, maxThreads);
+}
+
+void APrimesThreadTest::CancelPrimeTask()
+{
+	if (primeJob)
+		primeJob->Cancel();
 }
 
-// Called every frame
-void APrimesThreadTest::Tick(float DeltaTime)
+float APrimesThreadTest::GetPrimeTaskProgress() const
 {
-	Super::Tick(DeltaTime);
+	return primeJob ? primeJob->GetProgress() : 0.f;
+}
 
-	if (bLastBusyFindingPrimes && !*bBusyFindingPrimes)
+void APrimesThreadTest::StartPrimeJob(int32 numPrimesToFind, EPrimeSearchMethod method, int32 maxThreads)
+{
+	// a search still running is replaced without reporting back
+	if (primeJob)
 	{
-		bLastBusyFindingPrimes = false;
-		*bBusyFindingPrimes = false;
-		OnDoneFindingPrimes();
+		primeJob->OnFound.RemoveAll(this);
+		primeJob->OnCancelled.RemoveAll(this);
+		primeJob->Cancel();
 	}
+
+	primeJob = UFindPrimeAsyncJob::FindPrimeAsync(this, numPrimesToFind, method, maxThreads);
+	primeJob->OnFound.AddDynamic(this, &APrimesThreadTest::HandlePrimeFound);
+	primeJob->OnCancelled.AddDynamic(this, &APrimesThreadTest::HandlePrimeSearchCancelled);
+	primeJob->Activate();
 }
 
-void APrimesThreadTest::RunPrimeTaskOnBackgroundThread(int32 numPrimesToFind)
+void APrimesThreadTest::HandlePrimeFound(int64 prime)
 {
-	*bBusyFindingPrimes = true;
-	bLastBusyFindingPrimes = true;
-	(new FAutoDeleteAsyncTask<PrimeSearchTask>(numPrimesToFind, bBusyFindingPrimes))->StartBackgroundTask();
+	primeJob = nullptr;
+	OnDoneFindingPrimes();
 }
 
-void APrimesThreadTest::RunPrimeTaskOnMainThread(int32 numPrimesToFind)
+void APrimesThreadTest::HandlePrimeSearchCancelled()
 {
-	PrimeSearchTask pst(numPrimesToFind);
-	pst.DoWork();
+	primeJob = nullptr;
 	OnDoneFindingPrimes();
 }
-
@@ -3,31 +3,67 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "AsyncJob.h"
 #include "GameFramework/Actor.h"
 
-#include <atomic>
-
 #include "PrimesThreadTest.generated.h"
 
+UENUM(BlueprintType)
+enum class EPrimeSearchMethod : uint8
+{
+	/** Tests every number by division; deliberately slow, for keeping one core busy. */
+	TrialDivision,
+	/** The parallel segmented sieve. */
+	Sieve,
+	/** The sieve on 1, 2, 4... threads up to the most allowed, logging primes/s and speedup over one thread for each. */
+	SieveScaling,
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnPrimeFound, int64, Prime);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnPrimeSearchCancelled);
+
+/** Finds the nth prime on a worker thread. The node's Async Task pin is the handle for progress and cancellation. */
 UCLASS()
-class THIRDPERSON_API APrimesThreadTest : public AActor
+class THIRDPERSON_API UFindPrimeAsyncJob : public UAsyncJob
 {
 	GENERATED_BODY()
 
-	TSharedPtr< std::atomic_bool > bBusyFindingPrimes{ new std::atomic_bool( false ) };
-	bool bLastBusyFindingPrimes{ false };
-	
-public:	
-	// Sets default values for this actor's properties
-	APrimesThreadTest();
+public:
+	/**
+	 * MaxThreads limits the sieve methods, 0 meaning every hardware thread.
+	 * Higher priority jobs start before lower priority ones waiting for the same workers.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Primes", meta = (BlueprintInternalUseOnly = "true", WorldContext = "WorldContextObject"))
+	static UFindPrimeAsyncJob *FindPrimeAsync(
+		UObject *WorldContextObject, int32 NumPrimesToFind, EPrimeSearchMethod Method, int32 MaxThreads = 0, float Priority = 0.f);
+
+	/** Fired on the game thread with the NumPrimesToFind'th prime. */
+	UPROPERTY(BlueprintAssignable)
+	FOnPrimeFound OnFound;
+
+	UPROPERTY(BlueprintAssignable)
+	FOnPrimeSearchCancelled OnCancelled;
+
+	void Activate() override;
 
 protected:
-	// Called when the game starts or when spawned
-  void BeginPlay() override;
+	void OnJobCancelled() override;
 
-public:	
-	// Called every frame
-	void Tick(float DeltaTime) override;
+private:
+	int32 NumPrimesToFind = 0;
+	EPrimeSearchMethod Method = EPrimeSearchMethod::TrialDivision;
+	int32 MaxThreads = 0;
+	float Priority = 0.f;
+};
+
+UCLASS()
+class THIRDPERSON_API APrimesThreadTest : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this actor's properties
+	APrimesThreadTest();
 
 	UFUNCTION(BlueprintCallable)
 	void RunPrimeTaskOnBackgroundThread(int32 numPrimesToFind);
@@ -35,6 +71,33 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void RunPrimeTaskOnMainThread(int32 numPrimesToFind);
 
+	/**
+	 * Finds the numPrimesToFind'th prime with the parallel segmented sieve, once each on 1, 2, 4... threads up to
+	 * maxThreads, or every hardware thread if 0, and logs primes sieved per second and the speedup over one thread for each.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void RunPrimeSieveScalingOnBackgroundThread(int32 numPrimesToFind, int32 maxThreads = 0);
+
+	/** Stops the background search, if one is running; OnDoneFindingPrimes still follows. */
+	UFUNCTION(BlueprintCallable)
+	void CancelPrimeTask();
+
+	/** Fraction of the background search done, or 0 if there is none. */
+	UFUNCTION(BlueprintPure)
+	float GetPrimeTaskProgress() const;
+
 	UFUNCTION(BlueprintImplementableEvent)
 	void OnDoneFindingPrimes();
+
+private:
+	void StartPrimeJob(int32 numPrimesToFind, EPrimeSearchMethod method, int32 maxThreads = 0);
+
+	UFUNCTION()
+	void HandlePrimeFound(int64 prime);
+
+	UFUNCTION()
+	void HandlePrimeSearchCancelled();
+
+	UPROPERTY(Transient)
+	UFindPrimeAsyncJob *primeJob = nullptr;
 };
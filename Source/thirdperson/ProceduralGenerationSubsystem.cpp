@@ -0,0 +1,322 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ProceduralGenerationSubsystem.h"
+
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "MeshDescription.h"
+
+namespace
+{
+  bool
+  runsBefore(const float priorityA, const uint64 sequenceA, const float priorityB, const uint64 sequenceB)
+  {
+    return priorityA != priorityB ? priorityA > priorityB : sequenceA < sequenceB;
+  }
+
+  UStaticMesh *
+  buildStaticMesh(UObject *outer, FMeshDescription &meshDescription)
+  {
+    if (meshDescription.Triangles().Num() <= 0)
+      return nullptr;
+
+    UStaticMesh *staticMesh = NewObject<UStaticMesh>(outer, NAME_None, RF_Transient);
+    staticMesh->GetStaticMaterials().Add(FStaticMaterial{}); // one section; the material is set per instanced component
+
+    UStaticMesh::FBuildMeshDescriptionsParams params;
+    params.bMarkPackageDirty = false;
+    params.bBuildSimpleCollision = false;
+    staticMesh->BuildFromMeshDescriptions({&meshDescription}, params);
+
+    return staticMesh;
+  }
+} // namespace
+
+//==============================================================================
+
+class FProceduralGenerationPool::FWorker : public FRunnable
+{
+  FProceduralGenerationPool &Pool;
+  FRunnableThread *Thread;
+
+public:
+  FWorker(FProceduralGenerationPool &InPool, const int32 Index)
+    : Pool{InPool}
+    // below the game and render threads, so that generation never competes with them for a core
+    , Thread{FRunnableThread::Create(this, *FString::Printf(TEXT("ProceduralGenerationWorker%d"), Index), 0, TPri_BelowNormal)}
+  {}
+
+  ~FWorker() override
+  {
+    if (Thread)
+    {
+      Thread->WaitForCompletion();
+      delete Thread;
+    }
+  }
+
+  uint32 Run() override
+  {
+    for (FJob job; Pool.WaitForJob(job);)
+    {
+      job.Work();
+      job.Work.Reset(); // release what the job holds before waiting for the next one
+    }
+
+    return 0;
+  }
+};
+
+//==============================================================================
+
+FProceduralGenerationPool::FProceduralGenerationPool(const int32 NumWorkers)
+  : WorkEvent{FPlatformProcess::GetSynchEventFromPool(false)}
+{
+  for (int32 i = 0; i < FMath::Max(1, NumWorkers); ++i)
+    Workers.Add(new FWorker(*this, i));
+}
+
+FProceduralGenerationPool::~FProceduralGenerationPool()
+{
+  Stop();
+  FPlatformProcess::ReturnSynchEventToPool(WorkEvent);
+}
+
+bool FProceduralGenerationPool::Submit(TUniqueFunction<void()> Work, const float Priority)
+{
+  {
+    FScopeLock lock(&Mutex);
+    if (bStopping)
+      return false;
+
+    Queue.HeapPush({MoveTemp(Work), Priority, NextSequence++}, [](const FJob &a, const FJob &b)
+    {
+      return runsBefore(a.Priority, a.Sequence, b.Priority, b.Sequence);
+    });
+  }
+
+  WorkEvent->Trigger();
+  return true;
+}
+
+void FProceduralGenerationPool::Stop()
+{
+  {
+    FScopeLock lock(&Mutex);
+    if (bStopping)
+      return;
+    bStopping = true;
+  }
+
+  // each worker drains the queue and ends; wake them all, since an auto-reset event wakes one at a time
+  for (int32 i = 0; i < Workers.Num(); ++i)
+    WorkEvent->Trigger();
+
+  for (FWorker *worker : Workers)
+    delete worker; // waits for it
+  Workers.Reset();
+}
+
+int32 FProceduralGenerationPool::GetNumQueued() const
+{
+  FScopeLock lock(&Mutex);
+  return Queue.Num();
+}
+
+bool FProceduralGenerationPool::WaitForJob(FJob &OutJob)
+{
+  for (;;)
+  {
+    {
+      FScopeLock lock(&Mutex);
+
+      if (!Queue.IsEmpty())
+      {
+        Queue.HeapPop(OutJob, [](const FJob &a, const FJob &b)
+        {
+          return runsBefore(a.Priority, a.Sequence, b.Priority, b.Sequence);
+        }, false);
+
+        // more work left: make sure another worker wakes for it
+        if (!Queue.IsEmpty())
+          WorkEvent->Trigger();
+        return true;
+      }
+
+      if (bStopping)
+      {
+        WorkEvent->Trigger(); // pass the wake-up on to the next worker
+        return false;
+      }
+    }
+
+    WorkEvent->Wait();
+  }
+}
+
+//==============================================================================
+
+void UProceduralGenerationSubsystem::Initialize(FSubsystemCollectionBase &Collection)
+{
+  Super::Initialize(Collection);
+
+  // the pool is started by the first work submitted, since most worlds (editor previews, thumbnails) never generate anything
+}
+
+void UProceduralGenerationSubsystem::Deinitialize()
+{
+  // queued work runs before the workers end, so everyone waiting for a job of theirs gets it back
+  if (Pool)
+    Pool->Stop();
+  Pool.Reset();
+  Completed.Reset();
+  Completing.Reset();
+
+  PendingSharedMeshes.Reset();
+  InstanceGroups.Reset();
+  PlacementGroups.Reset();
+  SharedMeshes.Reset();
+  InstanceHost = nullptr; // destroyed with the world
+
+  Super::Deinitialize();
+}
+
+UProceduralGenerationSubsystem::FPoolPtr UProceduralGenerationSubsystem::GetPool()
+{
+  // leave cores for the game, render and RHI threads
+  if (!Pool)
+    Pool = MakeShared<FProceduralGenerationPool, ESPMode::ThreadSafe>(FMath::Clamp(FPlatformMisc::NumberOfCores() - 3, 1, 8));
+
+  return Pool;
+}
+
+void UProceduralGenerationSubsystem::Submit(
+  const UObject *Owner, TUniqueFunction<void()> Work, TUniqueFunction<void()> OnComplete, const float Priority)
+{
+  GetPool()->Submit([this, owner = TWeakObjectPtr<const UObject>{Owner}, work = MoveTemp(Work), onComplete = MoveTemp(OnComplete)]() mutable
+  {
+    work();
+
+    if (onComplete)
+    {
+      FScopeLock lock(&CompletedMutex);
+      Completed.Add({owner, MoveTemp(onComplete)});
+    }
+  }, Priority);
+}
+
+void UProceduralGenerationSubsystem::Tick(float DeltaTime)
+{
+  {
+    FScopeLock lock(&CompletedMutex);
+    Swap(Completed, Completing);
+  }
+
+  for (FCompletion &completion : Completing)
+    if (completion.Owner.IsExplicitlyNull() || completion.Owner.IsValid())
+      completion.OnComplete();
+
+  Completing.Reset();
+}
+
+TStatId UProceduralGenerationSubsystem::GetStatId() const
+{
+  RETURN_QUICK_DECLARE_CYCLE_STAT(UProceduralGenerationSubsystem, STATGROUP_Tickables);
+}
+
+//------------------------------------------------------------------------------
+
+void UProceduralGenerationSubsystem::RequestSharedMesh(
+  const uint64 ContentHash, const UObject *Owner, FMeshGenerator Generate, FOnSharedMeshReady OnReady, const float Priority)
+{
+  if (UStaticMesh *const *mesh = SharedMeshes.Find(ContentHash))
+  {
+    OnReady(*mesh);
+    return;
+  }
+
+  if (TArray<FMeshWaiter> *waiters = PendingSharedMeshes.Find(ContentHash))
+  {
+    waiters->Add({Owner, MoveTemp(OnReady)});
+    return;
+  }
+
+  PendingSharedMeshes.Add(ContentHash).Add({Owner, MoveTemp(OnReady)});
+
+  // generated for everyone waiting, so it must not depend on the requester still being around
+  const TSharedRef<FMeshDescription, ESPMode::ThreadSafe> meshDescription = MakeShared<FMeshDescription, ESPMode::ThreadSafe>();
+  Submit(this,
+    [meshDescription, generate = MoveTemp(Generate)] { generate(*meshDescription); },
+    [this, ContentHash, meshDescription] { FinishSharedMesh(ContentHash, MoveTemp(*meshDescription)); },
+    Priority);
+}
+
+void UProceduralGenerationSubsystem::FinishSharedMesh(const uint64 ContentHash, FMeshDescription &&MeshDescription)
+{
+  TArray<FMeshWaiter> waiters;
+  PendingSharedMeshes.RemoveAndCopyValue(ContentHash, waiters);
+
+  UStaticMesh *mesh = buildStaticMesh(this, MeshDescription);
+  if (mesh)
+    SharedMeshes.Add(ContentHash, mesh);
+
+  for (FMeshWaiter &waiter : waiters)
+    if (waiter.Owner.IsExplicitlyNull() || waiter.Owner.IsValid())
+      waiter.OnReady(mesh);
+}
+
+void UProceduralGenerationSubsystem::AddSharedMeshInstance(
+  UStaticMesh *Mesh, UMaterialInterface *Material, const FTransform &Transform, const UObject *Placement)
+{
+  if (!Mesh)
+    return;
+
+  RemoveSharedMeshInstance(Placement);
+
+  if (!InstanceHost)
+  {
+    FActorSpawnParameters spawnParameters;
+    spawnParameters.ObjectFlags = RF_Transient;
+    InstanceHost = GetWorld()->SpawnActor<AActor>(spawnParameters);
+    InstanceHost->SetRootComponent(NewObject<USceneComponent>(InstanceHost, TEXT("Root")));
+    InstanceHost->GetRootComponent()->RegisterComponent();
+#if WITH_EDITOR
+    InstanceHost->SetActorLabel(TEXT("SharedMeshInstances"));
+#endif
+  }
+
+  const FInstanceGroupKey key{Mesh, Material};
+  FInstanceGroup &group = InstanceGroups.FindOrAdd(key);
+
+  if (!group.Component)
+  {
+    group.Component = NewObject<UInstancedStaticMeshComponent>(InstanceHost);
+    group.Component->SetStaticMesh(Mesh);
+    group.Component->SetMaterial(0, Material);
+    group.Component->SetupAttachment(InstanceHost->GetRootComponent());
+    group.Component->RegisterComponent();
+    InstanceHost->AddInstanceComponent(group.Component);
+  }
+
+  group.Component->AddInstance(Transform, true);
+  group.Placements.Add(Placement);
+  PlacementGroups.Add(Placement, key);
+}
+
+void UProceduralGenerationSubsystem::RemoveSharedMeshInstance(const UObject *Placement)
+{
+  FInstanceGroupKey key;
+  if (!PlacementGroups.RemoveAndCopyValue(Placement, key))
+    return;
+
+  FInstanceGroup &group = InstanceGroups.FindChecked(key);
+
+  // removing an instance moves those after it down by one, the same as removing its placement does
+  const int32 index = group.Placements.IndexOfByKey(Placement);
+  group.Placements.RemoveAt(index);
+  if (IsValid(group.Component))
+    group.Component->RemoveInstance(index);
+}
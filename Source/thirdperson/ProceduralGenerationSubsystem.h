@@ -0,0 +1,156 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "ProceduralGenerationSubsystem.generated.h"
+
+class FRunnableThread;
+class UInstancedStaticMeshComponent;
+struct FMeshDescription;
+
+/**
+ * A fixed set of worker threads with one queue, shared by everything that generates procedural content in a world.
+ * Higher priority work runs first, work of equal priority in the order it was submitted.
+ */
+class THIRDPERSON_API FProceduralGenerationPool
+{
+public:
+  explicit FProceduralGenerationPool(int32 NumWorkers);
+  ~FProceduralGenerationPool();
+
+  /** Queues Work for a worker. Once the pool has stopped, Work is dropped without running and false returned. */
+  bool Submit(TUniqueFunction<void()> Work, float Priority = 0.f);
+
+  /** Runs what is already queued, then ends the workers. Work submitted meanwhile is dropped. */
+  void Stop();
+
+  int32 GetNumWorkers() const { return Workers.Num(); }
+
+  /** Work waiting for a worker. */
+  int32 GetNumQueued() const;
+
+private:
+  class FWorker;
+
+  struct FJob
+  {
+    TUniqueFunction<void()> Work;
+    float Priority;
+    uint64 Sequence;
+  };
+
+  // next job to run, or false once stopping and nothing is left
+  bool WaitForJob(FJob &OutJob);
+
+  mutable FCriticalSection Mutex;
+  FEvent *WorkEvent;          // triggered whenever a job is queued, and when stopping
+  TArray<FJob> Queue;         // lock before access; heap, by priority then sequence
+  uint64 NextSequence = 0;    // lock before access
+  bool bStopping = false;     // lock before access
+  TArray<FWorker*> Workers;
+};
+
+/**
+ * Owns the world's FProceduralGenerationPool, so that the number of generation threads stays the same however
+ * many procedural actors there are. Work can be submitted with a completion that runs on the game thread.
+ *
+ * Also shares generated meshes: a mesh is generated once per distinct content, identified by a hash of whatever it
+ * is generated from, and every placement of it in the world is drawn through one instanced component.
+ */
+UCLASS()
+class THIRDPERSON_API UProceduralGenerationSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+  GENERATED_BODY()
+
+public:
+  using FPoolPtr = TSharedPtr<FProceduralGenerationPool, ESPMode::ThreadSafe>;
+
+  void Initialize(FSubsystemCollectionBase &Collection) override;
+  void Deinitialize() override;
+
+  /**
+   * Runs Work on the pool, then OnComplete, if any, on the game thread during the subsystem's next tick,
+   * unless Owner has been destroyed by then. Work must not touch Owner.
+   */
+  void Submit(const UObject *Owner, TUniqueFunction<void()> Work, TUniqueFunction<void()> OnComplete, float Priority = 0.f);
+
+  /**
+   * The pool, for work that collects its own results, started on first use. It stops when the world goes away;
+   * keep it for as long as work may be submitted.
+   */
+  FPoolPtr GetPool();
+
+  //------------------------------------------------------------------------------
+  // Shared meshes
+
+  using FMeshGenerator = TUniqueFunction<void(FMeshDescription &OutMeshDescription)>;
+  using FOnSharedMeshReady = TUniqueFunction<void(UStaticMesh *Mesh)>;
+
+  /**
+   * Calls OnReady on the game thread with the world's mesh for ContentHash, unless Owner has been destroyed by then.
+   * Only the first request for a hash generates anything: Generate runs on the pool and the mesh is built from its
+   * output; requests made meanwhile wait for that mesh, and later ones get it straight away, before this returns.
+   * Every request for a hash must describe the same mesh. The mesh is null if the description has no triangles.
+   */
+  void RequestSharedMesh(uint64 ContentHash, const UObject *Owner, FMeshGenerator Generate, FOnSharedMeshReady OnReady, float Priority = 0.f);
+
+  /** Draws Mesh with Material at Transform on behalf of Placement, through the one instanced component for that pair. */
+  void AddSharedMeshInstance(UStaticMesh *Mesh, UMaterialInterface *Material, const FTransform &Transform, const UObject *Placement);
+
+  /** Removes the instance drawn on behalf of Placement, if there is one. */
+  void RemoveSharedMeshInstance(const UObject *Placement);
+
+  int32 GetNumSharedMeshes() const { return SharedMeshes.Num(); }
+
+  //------------------------------------------------------------------------------
+  // FTickableGameObject
+
+  void Tick(float DeltaTime) override;
+  TStatId GetStatId() const override;
+  bool IsTickableInEditor() const override { return true; }
+  ETickableTickType GetTickableTickType() const override { return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Always; }
+  UWorld *GetTickableGameObjectWorld() const override { return GetWorld(); }
+
+private:
+  struct FCompletion
+  {
+    TWeakObjectPtr<const UObject> Owner;
+    TUniqueFunction<void()> OnComplete;
+  };
+
+  struct FMeshWaiter
+  {
+    TWeakObjectPtr<const UObject> Owner;
+    FOnSharedMeshReady OnReady;
+  };
+
+  using FInstanceGroupKey = TPair<UStaticMesh*, UMaterialInterface*>;
+
+  struct FInstanceGroup
+  {
+    UInstancedStaticMeshComponent *Component = nullptr; // owned by InstanceHost
+    TArray<const UObject*> Placements;                  // one per instance, in instance order
+  };
+
+  void FinishSharedMesh(uint64 ContentHash, FMeshDescription &&MeshDescription);
+
+  FPoolPtr Pool;
+
+  UPROPERTY(Transient)
+  TMap<uint64, UStaticMesh*> SharedMeshes;             // by content hash
+
+  TMap<uint64, TArray<FMeshWaiter>> PendingSharedMeshes; // being generated, with who is waiting for them
+
+  UPROPERTY(Transient)
+  AActor *InstanceHost = nullptr;                       // spawned with the first instance; holds the instanced components
+
+  TMap<FInstanceGroupKey, FInstanceGroup> InstanceGroups;
+  TMap<const UObject*, FInstanceGroupKey> PlacementGroups;
+
+  FCriticalSection CompletedMutex;
+  TArray<FCompletion> Completed; // lock before access
+  TArray<FCompletion> Completing; // game thread only; swapped with Completed every tick
+};
@@ -4,25 +4,52 @@
 #include "ProceduralLandscape.h"
 
 #include "Chunk.h"
+#include "ChunkStorage.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
 #include "Core/Public/Math/UnrealMathUtility.h"
-#include "HAL/RunnableThread.h"
+#include "HAL/LowLevelMemTracker.h"
+#include "HeightSources.h"
+#include "HeightfieldVirtualTexture.h"
 #include "Kismet/GameplayStatics.h"
+#include "Misc/Paths.h"
+#include "ProceduralGenerationSubsystem.h"
 #include "ProceduralMeshComponent.h"
 #include "ProceduralMeshConversion.h"
-
-#include <chrono>
+#include "RenderCore.h"
+#include "RendererInterface.h"
+#include "RenderingThread.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "TiledHeightmap.h"
+#include "VT/RuntimeVirtualTexture.h"
+
+#include <atomic>
 #include <cmath>
 #include <condition_variable>
 #include <deque>
 #include <memory>
 #include <mutex>
 #include <optional>
-#include <stack>
+
+// memory accounting: LLM tags show up under 'ProceduralLandscape' in the LLM report (-llm),
+// the memory stats under 'stat ProceduralLandscape'
+LLM_DEFINE_TAG(ProceduralLandscape);
+LLM_DEFINE_TAG(ProceduralLandscape_Generation, NAME_None, TEXT("ProceduralLandscape"));
+LLM_DEFINE_TAG(ProceduralLandscape_Meshes, NAME_None, TEXT("ProceduralLandscape"));
+LLM_DEFINE_TAG(ProceduralLandscape_Collision, NAME_None, TEXT("ProceduralLandscape"));
+
+DECLARE_STATS_GROUP(TEXT("ProceduralLandscape"), STATGROUP_ProceduralLandscape, STATCAT_Advanced);
+DECLARE_MEMORY_STAT(TEXT("Chunk Meshes"), STAT_ProceduralLandscape_MeshMemory, STATGROUP_ProceduralLandscape);
+DECLARE_MEMORY_STAT(TEXT("Chunk Collision"), STAT_ProceduralLandscape_CollisionMemory, STATGROUP_ProceduralLandscape);
+DECLARE_MEMORY_STAT(TEXT("Work Unit Pool"), STAT_ProceduralLandscape_PoolMemory, STATGROUP_ProceduralLandscape);
+DECLARE_MEMORY_STAT(TEXT("Terrain Edits"), STAT_ProceduralLandscape_EditMemory, STATGROUP_ProceduralLandscape);
+DECLARE_MEMORY_STAT(TEXT("Heightfield Cache"), STAT_ProceduralLandscape_HeightfieldMemory, STATGROUP_ProceduralLandscape);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Loaded Chunks"), STAT_ProceduralLandscape_LoadedChunks, STATGROUP_ProceduralLandscape);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Generation Queue"), STAT_ProceduralLandscape_GenerationQueue, STATGROUP_ProceduralLandscape);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Generation Concurrency"), STAT_ProceduralLandscape_GenerationConcurrency, STATGROUP_ProceduralLandscape);
 
 namespace
 {
-  using clock_t = std::chrono::high_resolution_clock;
-  
   struct MeshData
   {
     TArray<FVector> vertices;
@@ -33,31 +60,315 @@ namespace
     TArray<FProcMeshTangent> tangents;
   };
 
-  struct GenerationWorkUnit
+  struct TerrainParameters
   {
-    MeshData meshData{}; // local coordinates always from (0,0) to (size,size)
-    FIntVector chunkLocation{}; // world coordinates of center are chunkLocation * size
     int32 resolution{1};
     float size{1.f};
     float horizontalNoiseScale{1.f};
     float verticalScale{1.f};
+    float meshErrorTolerance{}; // zero for a full grid, else chunk meshes are simplified within this height error
+    int32 heightSource{}; // ELandscapeHeightSource; all fields are 4 bytes so that parameters compare bytewise
+    int32 octaves{1};
+    float lacunarity{2.f};
+    float gain{0.5f};
+    float ridgeWeight{};
+    int32 bicubicHeightmap{};
+    uint32 heightmapId{}; // which opened heightmap the heightmap source reads, see Private::currentTerrainParameters
+    int32 volumetric{}; // 3D chunks meshed from a density field, see sampleVolume
+    float caveScale{1.f};
+    float caveDepth{};
   };
 
-  struct MeshPointCache
+  using TiledHeightmapPtr = TSharedPtr<const FTiledHeightmap, ESPMode::ThreadSafe>;
+
+  // Sparse height offsets for one chunk, on a regular grid that includes a one-vertex ring around the chunk
+  // so that normals can be taken across chunk borders. Vertices shared with neighboring chunks hold equal values.
+  struct ChunkEdits
   {
-    TArray<FVector> points;
+    int32 resolution{}; // grid steps per chunk side, independent of the current StepsPerChunk
+    TArray<float> deltas; // (resolution + 3)^2 values for x,y in [-1, resolution + 1]
+
+    explicit ChunkEdits(const int32 resolution)
+      : resolution{resolution}
+    {
+      deltas.SetNumZeroed((resolution + 3) * (resolution + 3));
+    }
+
+    float &at(const int32 x, const int32 y) { return deltas[(x + 1) + (y + 1) * (resolution + 3)]; }
+    float at(const int32 x, const int32 y) const { return deltas[(x + 1) + (y + 1) * (resolution + 3)]; }
+
+    // bilinear sample at fractional grid coordinates, clamped to the grid including its outer ring
+    float
+    sample(float x, float y) const
+    {
+      x = FMath::Clamp(x, -1.f, resolution + 1.f);
+      y = FMath::Clamp(y, -1.f, resolution + 1.f);
+      const int32 x0 = FMath::Min(FMath::FloorToInt(x), resolution);
+      const int32 y0 = FMath::Min(FMath::FloorToInt(y), resolution);
+      const float fx = x - x0, fy = y - y0;
+      return FMath::Lerp(
+        FMath::Lerp(at(x0, y0), at(x0 + 1, y0), fx),
+        FMath::Lerp(at(x0, y0 + 1), at(x0 + 1, y0 + 1), fx),
+        fy);
+    }
   };
 
-  std::optional<FVector>
-  tryGetPlayerLocation(const AActor *anyActorInWorld)
+  using ChunkEditsPtr = TSharedPtr<ChunkEdits, ESPMode::ThreadSafe>;
+  using ChunkEditsSnapshot = TSharedPtr<const ChunkEdits, ESPMode::ThreadSafe>;
+
+  // Saved form of a chunk's edits, for UChunkStorage. The chunk size is kept so that edits saved for another
+  // chunk grid are never applied to this one.
+  TArray<uint8>
+  serializeEdits(const ChunkEdits &edits, float chunkSize)
+  {
+    TArray<uint8> data;
+    FMemoryWriter writer{data};
+    int32 resolution = edits.resolution;
+    writer << chunkSize << resolution;
+    writer.Serialize(const_cast<float *>(edits.deltas.GetData()), edits.deltas.Num() * sizeof(float));
+    return data;
+  }
+
+  // Null if the data is damaged or was saved for chunks of another size.
+  ChunkEditsPtr
+  deserializeEdits(const TArray<uint8> &data, const float chunkSize)
+  {
+    FMemoryReader reader{data};
+    float savedChunkSize{};
+    int32 resolution{};
+    reader << savedChunkSize << resolution;
+    if (reader.IsError() || savedChunkSize != chunkSize || resolution < 1 || resolution > 4096)
+      return nullptr;
+
+    ChunkEditsPtr edits = MakeShared<ChunkEdits, ESPMode::ThreadSafe>(resolution);
+    if (data.Num() - reader.Tell() != edits->deltas.Num() * sizeof(float))
+      return nullptr;
+    reader.Serialize(edits->deltas.GetData(), edits->deltas.Num() * sizeof(float));
+    return reader.IsError() ? nullptr : edits;
+  }
+
+  // Heights a chunk was meshed from, edits included. Immutable once generated, so any thread may read it.
+  struct ChunkHeightfield
+  {
+    FIntVector chunkLocation{};
+    TerrainParameters parameters{};
+    TArray<float> heights; // (resolution + 1)^2, row-major from the chunk's min corner
+
+    // Height and surface normal at a world location inside this chunk, on the same triangles the chunk mesh uses.
+    float
+    sample(const FVector2D localLocation, FVector *normal = nullptr) const
+    {
+      const int32 n = parameters.resolution;
+      const float step = parameters.size / n;
+
+      const float gx = FMath::Clamp(localLocation.X / step, 0.f, float(n));
+      const float gy = FMath::Clamp(localLocation.Y / step, 0.f, float(n));
+      const int32 x = FMath::Min(int32(gx), n - 1);
+      const int32 y = FMath::Min(int32(gy), n - 1);
+      const float fx = gx - x, fy = gy - y;
+
+      const int32 index = x + y * (n + 1);
+      const float h00 = heights[index];
+      const float h10 = heights[index + 1];
+      const float h01 = heights[index + n + 1];
+      const float h11 = heights[index + n + 2];
+
+      // each cell is split along its (x+1,y)-(x,y+1) diagonal
+      float height, dzdx, dzdy;
+      if (fx + fy <= 1.f)
+      {
+        dzdx = h10 - h00;
+        dzdy = h01 - h00;
+        height = h00 + fx * dzdx + fy * dzdy;
+      }
+      else
+      {
+        dzdx = h11 - h01;
+        dzdy = h11 - h10;
+        height = h11 - (1.f - fx) * dzdx - (1.f - fy) * dzdy;
+      }
+
+      if (normal)
+        *normal = FVector{-dzdx / step, -dzdy / step, 1.f}.GetUnsafeNormal();
+
+      return height;
+    }
+  };
+
+  using ChunkHeightfieldPtr = TSharedPtr<const ChunkHeightfield, ESPMode::ThreadSafe>;
+
+  // FLandscapeScatterLayer without the UObject references, for the generation tasks
+  struct ScatterRule
+  {
+    int32 count{};
+    float minSlopeCos{}, maxSlopeCos{}; // cosines, so maxSlopeCos <= minSlopeCos
+    float minHeight{}, maxHeight{};
+    float minScale{}, maxScale{};
+    bool alignToNormal{};
+    bool randomYaw{};
+
+    bool
+    operator==(const ScatterRule &other) const
+    {
+      return count == other.count && minSlopeCos == other.minSlopeCos && maxSlopeCos == other.maxSlopeCos
+        && minHeight == other.minHeight && maxHeight == other.maxHeight && minScale == other.minScale
+        && maxScale == other.maxScale && alignToNormal == other.alignToNormal && randomYaw == other.randomYaw;
+    }
+  };
+
+  using ScatterRulesPtr = TSharedPtr<const TArray<ScatterRule>, ESPMode::ThreadSafe>;
+
+  struct GenerationWorkUnit
+  {
+    MeshData meshData{}; // local coordinates always from (0,0) to (size,size)
+    TArray<FVector2D> gradients; // height gradient at every vertex, from the sample stage to the mesh stage
+    TArray<float> densities; // volumetric: (resolution + 2)^3 samples for the mesh stage; none for chunks of only air or rock
+    FIntVector chunkLocation{}; // world coordinates of center are chunkLocation * size
+    TerrainParameters parameters{};
+    uint32 parametersVersion{}; // stale, and discarded unmeshed, once the terrain parameters change again
+    ChunkEditsSnapshot edits; // height edits for this chunk, if any; shared with the game thread, never modified
+    ChunkHeightfieldPtr heightfield; // output alongside meshData, handed over to the height query cache
+    ELandscapeCollisionMode collisionMode{};
+    TUniquePtr<Chaos::FHeightField> collisionHeightfield; // output in heightfield collision mode
+    TiledHeightmapPtr heightmap; // read by the heightmap height source; kept open while this unit uses it
+    ScatterRulesPtr scatterRules;
+    TArray<TArray<FTransform>> scatterTransforms; // output: per scatter rule, relative to the chunk
+    bool collisionOnly{}; // only the heightfield and collision are output, meshData is left empty
+    bool withCollision{}; // false outside CollisionRadius: neither a heightfield nor cooked collision is made
+    bool remesh{}; // replaces the mesh of an already loaded chunk instead of spawning one
+    bool collisionUpdate{}; // with remesh: only adds heightfield collision to the loaded chunk, its mesh is kept
+  };
+
+  struct LoadedChunk
+  {
+    AChunk *actor{};
+    uint32 parametersVersion{}; // regenerated in place when behind the current terrain parameters
+    bool hasCollision{};
+    SIZE_T meshBytes{};        // render data of the chunk's static mesh
+    SIZE_T collisionBytes{};   // cooked collision of the chunk's static mesh
+    SIZE_T heightfieldBytes{}; // cached heights for queries
+  };
+
+  SIZE_T
+  allocatedBytes(const ChunkEdits &edits)
+  {
+    return sizeof(ChunkEdits) + edits.deltas.GetAllocatedSize();
+  }
+
+  SIZE_T
+  allocatedBytes(const ChunkHeightfield &heightfield)
+  {
+    return sizeof(ChunkHeightfield) + heightfield.heights.GetAllocatedSize();
+  }
+
+  SIZE_T
+  allocatedBytes(const GenerationWorkUnit &workUnit)
+  {
+    const auto& [vertices, triangles, normals, uv0, colors, tangents] = workUnit.meshData;
+    SIZE_T bytes =
+      sizeof(GenerationWorkUnit) + vertices.GetAllocatedSize() + triangles.GetAllocatedSize() + normals.GetAllocatedSize() +
+      uv0.GetAllocatedSize() + colors.GetAllocatedSize() + tangents.GetAllocatedSize() + workUnit.gradients.GetAllocatedSize() +
+      workUnit.densities.GetAllocatedSize();
+    for (const auto &transforms : workUnit.scatterTransforms)
+      bytes += transforms.GetAllocatedSize();
+    return bytes;
+  }
+
+  ScatterRule
+  getScatterRule(const FLandscapeScatterLayer &layer, const bool collisionOnly)
+  {
+    ScatterRule rule;
+    rule.count = layer.Mesh && (layer.bCollision || !collisionOnly) ? layer.InstancesPerChunk : 0;
+    rule.minSlopeCos = FMath::Cos(FMath::DegreesToRadians(layer.MinSlope));
+    rule.maxSlopeCos = FMath::Cos(FMath::DegreesToRadians(layer.MaxSlope));
+    rule.minHeight = layer.MinHeight;
+    rule.maxHeight = layer.MaxHeight;
+    rule.minScale = layer.MinScale;
+    rule.maxScale = FMath::Max(layer.MinScale, layer.MaxScale);
+    rule.alignToNormal = layer.bAlignToNormal;
+    rule.randomYaw = layer.bRandomYaw;
+    return rule;
+  }
+
+  // Replaces rules only when the layers no longer match them, so that unchanged layers cost a comparison per
+  // tick instead of a new array, and work units keep sharing the same one.
+  void
+  updateScatterRules(ScatterRulesPtr &rules, const TArray<FLandscapeScatterLayer> &layers, const bool collisionOnly)
+  {
+    bool changed = !rules || rules->Num() != layers.Num();
+    for (int32 i = 0; i < layers.Num() && !changed; ++i)
+      changed = !((*rules)[i] == getScatterRule(layers[i], collisionOnly));
+
+    if (!changed)
+      return;
+
+    const auto updated = MakeShared<TArray<ScatterRule>, ESPMode::ThreadSafe>();
+    updated->Reserve(layers.Num());
+    for (const FLandscapeScatterLayer &layer : layers)
+      updated->Add(getScatterRule(layer, collisionOnly));
+
+    rules = updated;
+  }
+
+  TerrainParameters
+  getTerrainParameters(const AProceduralLandscape &landscape)
+  {
+    TerrainParameters p;
+
+    p.resolution = landscape.StepsPerChunk;
+    p.size = landscape.ChunkSize;
+    p.horizontalNoiseScale = landscape.HorizontalNoiseScale;
+    p.verticalScale = landscape.VerticalScale;
+    p.meshErrorTolerance = landscape.MeshErrorTolerance;
+    p.heightSource = int32(landscape.HeightSource);
+    p.octaves = landscape.Octaves;
+    p.lacunarity = landscape.Lacunarity;
+    p.gain = landscape.Gain;
+    p.ridgeWeight = landscape.RidgeWeight;
+    p.bicubicHeightmap = landscape.bBicubicHeightmap;
+
+    if (landscape.bVolumetric)
+    {
+      p.volumetric = 1;
+      p.caveScale = landscape.CaveScale;
+      p.caveDepth = landscape.CaveDepth;
+    }
+
+    return p;
+  }
+
+  struct StreamingCenter
+  {
+    FVector location; // Z is zero unless chunks are volumetric
+    float rRadiusScale; // distances are divided by the radius scale, so that every radius compares against them as is
+    float rWeight;
+  };
+
+  // Every player's pawn, or camera if it has none. On a server these include remote players, on a client only local ones.
+  void
+  addPlayerStreamingCenters(const AActor *anyActorInWorld, TArray<StreamingCenter> &centers)
   {
     if (const auto actor = anyActorInWorld)
       if (const auto world = actor->GetWorld())
-        if (const auto firstPlayerController = world->GetFirstPlayerController())
-          if (const auto pawn = firstPlayerController->GetPawn())
-            return pawn->GetActorLocation();
+        for (auto it = world->GetPlayerControllerIterator(); it; ++it)
+          if (const APlayerController *playerController = it->Get())
+          {
+            if (const auto pawn = playerController->GetPawn())
+              centers.Add({pawn->GetActorLocation(), 1.f, 1.f});
+            else if (const auto cameraManager = playerController->PlayerCameraManager)
+              centers.Add({cameraManager->GetCameraLocation(), 1.f, 1.f});
+          }
+  }
 
-    return std::nullopt;
+  void
+  addStreamingSourceCenters(const TArray<FLandscapeStreamingSource> &sources, TArray<StreamingCenter> &centers)
+  {
+    for (const FLandscapeStreamingSource &source : sources)
+      if (IsValid(source.Actor))
+        centers.Add({
+          source.Actor->GetActorLocation(),
+          1.f / FMath::Max(source.RadiusScale, 0.01f),
+          1.f / FMath::Max(source.Weight, 0.01f)});
   }
 
   std::optional<FVector>
@@ -73,6 +384,18 @@ namespace
 
   //==============================================================================
 
+  // squared distance to the nearest center, scaled by that center's radius scale
+  float
+  distanceSquaredToNearest(const FIntVector chunk, const TArrayView<const StreamingCenter> centers, const float chunkSize)
+  {
+    const FVector chunkCenter = FVector(chunk) * chunkSize;
+
+    float nearest = TNumericLimits<float>::Max();
+    for (const StreamingCenter &center : centers)
+      nearest = FMath::Min(nearest, (chunkCenter - center.location).SizeSquared() * FMath::Square(center.rRadiusScale));
+    return nearest;
+  }
+
   FVector2D
   chunkLocationMinCornerCoordinates(
     const FIntVector chunkLocation,
@@ -81,6 +404,67 @@ namespace
     const auto [x,y,z] = chunkLocation;
     return FVector2D{x - 0.5f, y - 0.5f} * chunkSize;
   }
+
+  // of volumetric chunks, which are cubes
+  FVector
+  chunkLocationMinCorner3D(
+    const FIntVector chunkLocation,
+    const float chunkSize)
+  {
+    return (FVector(chunkLocation) - FVector{0.5f}) * chunkSize;
+  }
+
+  // Calls visitor with the height source the parameters select, as its concrete type, so that whatever visitor
+  // does with the source is compiled for each source separately with the source inlined.
+  // The heightmap source reads heightmap, which is the one parameters.heightmapId names; without one it falls back to Perlin.
+  template<typename Visitor>
+  FORCEINLINE decltype(auto)
+  visitHeightSource(const TerrainParameters &parameters, const FTiledHeightmap *heightmap, Visitor &&visitor)
+  {
+    using namespace noise;
+
+    switch (ELandscapeHeightSource(parameters.heightSource))
+    {
+    case ELandscapeHeightSource::Heightmap:
+      if (!heightmap)
+        return visitor(Perlin{});
+      if (parameters.bicubicHeightmap)
+        return visitor(Heightmap<true>{heightmap});
+      return visitor(Heightmap<false>{heightmap});
+    case ELandscapeHeightSource::Simplex:
+      return visitor(Simplex{});
+    case ELandscapeHeightSource::PerlinFbm:
+      return visitor(Fbm<Perlin>{{}, parameters.octaves, parameters.lacunarity, parameters.gain});
+    case ELandscapeHeightSource::SimplexFbm:
+      return visitor(Fbm<Simplex>{{}, parameters.octaves, parameters.lacunarity, parameters.gain});
+    case ELandscapeHeightSource::RidgedFbm:
+      return visitor(Fbm<Ridged<Perlin>>{{}, parameters.octaves, parameters.lacunarity, parameters.gain});
+    case ELandscapeHeightSource::HillsAndRidges:
+      return visitor(Sum<Fbm<Perlin>, Fbm<Ridged<Perlin>>>{
+        {{}, parameters.octaves, parameters.lacunarity, parameters.gain},
+        {{}, parameters.octaves, parameters.lacunarity, parameters.gain},
+        parameters.ridgeWeight});
+    default:
+      return visitor(Perlin{});
+    }
+  }
+
+  // height source sample at a world location, scaled to world height and gradient
+  noise::NoiseSample
+  sampleBaseHeightAndGradient(const TerrainParameters &parameters, const FTiledHeightmap *heightmap, const FVector2D worldLocation)
+  {
+    const FVector2D noiseLocation = worldLocation / parameters.horizontalNoiseScale;
+    const noise::NoiseSample sample = visitHeightSource(parameters, heightmap,
+      [&](const auto &source) { return source(noiseLocation.X, noiseLocation.Y); });
+
+    return {parameters.verticalScale * sample.value, sample.gradient * (parameters.verticalScale / parameters.horizontalNoiseScale)};
+  }
+
+  float
+  sampleBaseHeight(const TerrainParameters &parameters, const FTiledHeightmap *heightmap, const FVector2D worldLocation)
+  {
+    return sampleBaseHeightAndGradient(parameters, heightmap, worldLocation).value;
+  }
   
   void
   createProceduralMeshSection(
@@ -94,13 +478,26 @@ namespace
   
   //==============================================================================
   UStaticMesh *
-  convertProceduralMeshToStaticMesh(UObject *outerObject, UProceduralMeshComponent *ProcMeshComp)
+  convertProceduralMeshToStaticMesh(
+    UObject *outerObject,
+    UProceduralMeshComponent *ProcMeshComp,
+    const bool bCreateCollision = true,
+    const FOnAsyncPhysicsCookFinished &onCollisionCooked = {},
+    const float naniteFallbackPercentTriangles = -1.f)
   {
     // copied then modified from ProceduralMeshComponentDetails.cpp:
     // FProceduralMeshComponentDetails::ClickedOnConvertToStaticMesh()
+    //
+    // with onCollisionCooked bound, collision is cooked on a worker after the mesh is built instead of before;
+    // components using the mesh have no collision until their physics state is recreated from onCollisionCooked
+    //
+    // with naniteFallbackPercentTriangles not negative, Nanite data is built for the mesh along with a fallback mesh
+    // of that percentage of its triangles; the build is asynchronous and the mesh compiling for a while after this
     
     if (!ProcMeshComp)
       return nullptr;
+
+    LLM_SCOPE_BYTAG(ProceduralLandscape_Meshes);
     
     // FString NewNameSuggestion = FString(TEXT("ProcMesh"));
     // FString PackageName = FString(TEXT("/Game/Meshes/")) + NewNameSuggestion;
@@ -174,14 +571,17 @@ namespace
     // }
 
     // COMPLEX COLLISION
-    StaticMesh->CreateBodySetup();
+    if (bCreateCollision)
     {
+      LLM_SCOPE_BYTAG(ProceduralLandscape_Collision);
+      StaticMesh->CreateBodySetup();
       UBodySetup *NewBodySetup = StaticMesh->GetBodySetup();
       NewBodySetup->bMeshCollideAll = true;
       NewBodySetup->bGenerateMirroredCollision = false;
       NewBodySetup->bDoubleSidedGeometry = false;
       NewBodySetup->CollisionTraceFlag = CTF_UseComplexAsSimple;
-      NewBodySetup->CreatePhysicsMeshes();
+      if (!onCollisionCooked.IsBound())
+        NewBodySetup->CreatePhysicsMeshes();
     }
 
     // //// MATERIALS
@@ -200,6 +600,13 @@ namespace
     //   StaticMesh->GetStaticMaterials().Add(FStaticMaterial(Material));
     // }
 
+    // NANITE
+    if (naniteFallbackPercentTriangles >= 0.f)
+    {
+      StaticMesh->NaniteSettings.bEnabled = true;
+      StaticMesh->NaniteSettings.FallbackPercentTriangles = FMath::Clamp(naniteFallbackPercentTriangles / 100.f, 0.f, 1.f);
+    }
+
     //Set the Imported version before calling the build
     StaticMesh->ImportVersion = EImportStaticMeshVersion::LastVersion;
 
@@ -207,12 +614,91 @@ namespace
     StaticMesh->Build(false);
     StaticMesh->PostEditChange();
 
+    if (bCreateCollision && onCollisionCooked.IsBound())
+    {
+      LLM_SCOPE_BYTAG(ProceduralLandscape_Collision);
+      StaticMesh->GetBodySetup()->CreatePhysicsMeshesAsync(onCollisionCooked);
+    }
+
     // Notify asset registry of new asset
     // FAssetRegistryModule::AssetCreated(StaticMesh);
     // }
 
     return StaticMesh;
   }
+
+  UStaticMesh *
+  buildChunkStaticMesh(
+    AChunk *chunkActor,
+    const MeshData &meshData,
+    const bool bCreateCollision,
+    const FOnAsyncPhysicsCookFinished &onCollisionCooked = {},
+    const float naniteFallbackPercentTriangles = -1.f)
+  {
+    UProceduralMeshComponent *proceduralMesh = NewObject<UProceduralMeshComponent>(chunkActor);
+    
+    // proceduralMesh->bUseComplexAsSimpleCollision = true;
+    // proceduralMesh->SetMobility(EComponentMobility::Static);
+    // proceduralMesh->SetCollisionEnabled(ECollisionEnabled::QueryAndPhysics);
+    // proceduralMesh->SetCollisionObjectType(ECollisionChannel::ECC_WorldStatic);
+    
+    createProceduralMeshSection(proceduralMesh, 0, meshData);
+
+    UStaticMesh *staticMesh = convertProceduralMeshToStaticMesh(
+      chunkActor->StaticMeshComponent, proceduralMesh, bCreateCollision, onCollisionCooked, naniteFallbackPercentTriangles);
+
+    // these settings alone don't seem to enable pawn <-> complex collision
+    //staticMesh->ComplexCollisionMesh = staticMesh;
+
+    proceduralMesh->DestroyComponent();
+
+    return staticMesh;
+  }
+
+  void
+  measureChunkMemory(LoadedChunk &loadedChunk, UStaticMesh *staticMesh)
+  {
+    loadedChunk.meshBytes = 0;
+    loadedChunk.collisionBytes = 0;
+
+    if (staticMesh)
+    {
+      loadedChunk.meshBytes = staticMesh->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+      if (UBodySetup *bodySetup = staticMesh->GetBodySetup())
+        loadedChunk.collisionBytes = bodySetup->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+    }
+
+    if (const UChunkHeightfieldCollisionComponent *heightfieldCollision = loadedChunk.actor->HeightfieldCollisionComponent)
+      loadedChunk.collisionBytes += heightfieldCollision->GetHeightfieldMemorySize();
+
+    for (UHierarchicalInstancedStaticMeshComponent *scatter : loadedChunk.actor->ScatterComponents)
+      loadedChunk.meshBytes += scatter->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+  }
+
+  // Gives a chunk whose static mesh was just built from workUnit the collision workUnit asked for.
+  void
+  applyChunkCollision(LoadedChunk &loadedChunk, GenerationWorkUnit &workUnit)
+  {
+    if (workUnit.collisionHeightfield)
+      loadedChunk.actor->SetHeightfieldCollision(MoveTemp(workUnit.collisionHeightfield));
+    else if (workUnit.withCollision)
+      loadedChunk.actor->SetHeightfieldCollision(nullptr); // cooked into the static mesh
+    else
+      loadedChunk.actor->ClearCollision();
+
+    loadedChunk.hasCollision = workUnit.withCollision;
+  }
+
+  void
+  addScatter(AChunk *chunkActor, const TArray<FLandscapeScatterLayer> &layers, const TArray<TArray<FTransform>> &scatterTransforms)
+  {
+    LLM_SCOPE_BYTAG(ProceduralLandscape_Meshes);
+
+    // layers may have changed since the chunk was generated; the transforms are matched by index
+    for (int32 i = 0; i < FMath::Min(layers.Num(), scatterTransforms.Num()); ++i)
+      if (layers[i].Mesh && !scatterTransforms[i].IsEmpty())
+        chunkActor->AddScatter(layers[i].Mesh, scatterTransforms[i], layers[i].bCollision, layers[i].CullDistance);
+  }
   
   void
   enumerateChunksInRadius(
@@ -297,274 +783,1803 @@ namespace
           break;
       }
   }
-  
-  //------------------------------------------------------------------------------
 
-  void generateMesh(GenerationWorkUnit &workUnit, MeshPointCache &pointCache)
+  // Offsets to the chunks whose centers are within radiusInChunks of a chunk's center, nearest first.
+  TArray<FIntVector>
+  chunkOffsetsInSphere(const float radiusInChunks)
   {
-    // UE_LOG(LogTemp, Warning, TEXT("generateMesh(): xSteps(%d), ySteps(%d)"), meshParameters.xSteps, meshParameters.ySteps);
+    TArray<FIntVector> offsets;
 
-    auto &[vertices, triangles, normals, uv0, colors, tangents] = workUnit.meshData;
-    const int32 resolution = workUnit.resolution;
-    const float chunkSize = workUnit.size;
-    const float verticalScale = workUnit.verticalScale;
-    const float rNoiseScale = 1.f / workUnit.horizontalNoiseScale;
-    
-    const FVector2D minCorner = chunkLocationMinCornerCoordinates(workUnit.chunkLocation, chunkSize);
+    const int32 r = FMath::FloorToInt(radiusInChunks);
+    for (int32 z = -r; z <= r; ++z)
+      for (int32 y = -r; y <= r; ++y)
+        for (int32 x = -r; x <= r; ++x)
+          if (x * x + y * y + z * z <= radiusInChunks * radiusInChunks)
+            offsets.Emplace(x, y, z);
 
-    const float stepSize = chunkSize / resolution;
+    offsets.Sort([](const FIntVector a, const FIntVector b) { return a.SizeSquared() < b.SizeSquared(); });
+    return offsets;
+  }
 
-    // prepare pointCache
-    pointCache.points.Reset((resolution + 3) * (resolution + 3));
-    for (int32 y = -1; y <= resolution + 1; ++y)
-    {
-      const float yPos = y * stepSize;
-      const float yNoisePos = (minCorner.Y + yPos) * rNoiseScale;
+  // Sorted sphere offsets by radius in chunks; radii rarely change, but may step one chunk at a time while memory
+  // is tight, so a few are kept.
+  using SphereOffsetsCache = TMap<float, TArray<FIntVector>>;
+  constexpr int32 maxCachedSphereRadii = 8;
 
-      for (int32 x = -1; x <= resolution + 1; ++x)
-      {
-        const float xPos = x * stepSize;
-        const float xNoisePos = (minCorner.X + xPos) * rNoiseScale;
+  // The volumetric counterpart of enumerateChunksInRadius: chunks with centers within a sphere around the center
+  // of the chunk nearest center, nearest first. Only the offsets of a new radius are enumerated and sorted; the
+  // (2r+1)^3 candidates would otherwise be every tick.
+  void
+  enumerateChunksInSphere(
+    TArray<FIntVector>& chunksInRadius,
+    SphereOffsetsCache& sphereOffsets,
+    const FVector center,
+    const float radius,
+    const float chunkSize)
+  {
+    const FIntVector centerChunk{
+      FMath::FloorToInt(center.X / chunkSize + 0.5f),
+      FMath::FloorToInt(center.Y / chunkSize + 0.5f),
+      FMath::FloorToInt(center.Z / chunkSize + 0.5f)};
+    const float radiusInChunks = radius / chunkSize;
+
+    const TArray<FIntVector> *offsets = sphereOffsets.Find(radiusInChunks);
+    if (!offsets)
+    {
+      if (sphereOffsets.Num() >= maxCachedSphereRadii)
+        sphereOffsets.Reset();
+      offsets = &sphereOffsets.Add(radiusInChunks, chunkOffsetsInSphere(radiusInChunks));
+    }
 
-        float z = verticalScale * FMath::PerlinNoise2D(FVector2D{xNoisePos, yNoisePos});
+    chunksInRadius.Reset(offsets->Num());
+    for (const FIntVector offset : *offsets)
+      chunksInRadius.Add(centerChunk + offset);
+  }
+  
+  //------------------------------------------------------------------------------
 
-        pointCache.points.Emplace(xPos, yPos, z);
-      }
+  // Places each scatter rule's instances on the chunk's heightfield. Seeded from the chunk location and
+  // rule index only, so a chunk gets the same props every time it is generated.
+  void scatterProps(GenerationWorkUnit &workUnit)
+  {
+    if (!workUnit.scatterRules)
+    {
+      workUnit.scatterTransforms.Reset();
+      return;
     }
 
-    auto pointAt = [&points=pointCache.points,w=resolution+3](const int32 x, const int32 y)
-    {
-      return points[1 + x + (1 + y) * w];
-    };
-    
-    // make arrays big enough to hold all vertices
-    [totalNumVertices=(resolution + 1) * (resolution + 1)]
-    (auto& ... object) { (object.Reset(totalNumVertices), ...); }
-      (vertices, normals, uv0, colors, tangents);
+    const TArray<ScatterRule> &rules = *workUnit.scatterRules;
+    const ChunkHeightfield &heightfield = *workUnit.heightfield;
+    const float chunkSize = workUnit.parameters.size;
 
-    const float rStepSize = resolution / chunkSize;
-    const FVector2D minCornerUV = 0.01f * minCorner;
-    const float uvStepSize = 0.01f * chunkSize / resolution; // 1 meter per texture UV unit
+    workUnit.scatterTransforms.SetNum(rules.Num());
 
-    // set vertex values
-    for (int32 y = 0; y <= resolution; ++y)
+    for (int32 ruleIndex = 0; ruleIndex < rules.Num(); ++ruleIndex)
     {
-      const float texV0 = minCornerUV.Y + y * uvStepSize;
-      
-      for (int32 x = 0; x <= resolution; ++x)
+      const ScatterRule &rule = rules[ruleIndex];
+      TArray<FTransform> &transforms = workUnit.scatterTransforms[ruleIndex];
+      transforms.Reset(rule.count);
+
+      FRandomStream random{int32(HashCombine(GetTypeHash(workUnit.chunkLocation), uint32(ruleIndex)))};
+
+      for (int32 i = 0; i < rule.count; ++i)
       {
-        const float texU0 = minCornerUV.X + x * uvStepSize;
-        
-        const FVector yn = pointAt(x, y - 1);
-        const FVector xn = pointAt(x - 1, y);
-        const FVector xy = pointAt(x, y);
-        const FVector xp = pointAt(x + 1, y);
-        const FVector yp = pointAt(x, y + 1);
-
-        // thanks https://stackoverflow.com/a/21660173
-        // for the simple and good looking normal approximation
-        FVector normal = FVector{ (xn.Z - xp.Z) * rStepSize, (yn.Z - yp.Z) * rStepSize, 2.f}.GetUnsafeNormal();
-        normal.Normalize();
-
-        // TODO: calculate tangents
-        
-        vertices.Emplace(xy);
-        normals.Emplace(normal);
-        uv0.Emplace(texU0, texV0);
-        colors.Emplace(1.f, 1.f, 1.f, 1.f);
-        tangents.Emplace(1.f, 0.f, 0.f);
-      }
-    }
+        // draw every random number for a candidate up front so rejections don't shift later candidates
+        const FVector2D location{random.FRand() * chunkSize, random.FRand() * chunkSize};
+        const float yaw = random.FRand() * 360.f;
+        const float scale = random.FRandRange(rule.minScale, rule.maxScale);
 
-    // make triangles array big enough to hold all triangles
-    triangles.Reset(resolution * resolution * 2 * 3);
+        FVector normal;
+        const float height = heightfield.sample(location, &normal);
 
-    int32 count = 0;
+        if (normal.Z > rule.minSlopeCos || normal.Z < rule.maxSlopeCos || height < rule.minHeight || height > rule.maxHeight)
+          continue;
 
-    // set triangle indices
-    for (int32 y = 0, index = 0; y < resolution; ++y, ++index)
-        for (int32 x = 0; x < resolution; ++x, ++index)
-        {
-          triangles.Append({index, index + resolution + 1, index + 1});
-          triangles.Append({index + 1, index + resolution + 1, index + resolution + 2});
-          ++count;
-        }
+        FQuat rotation = rule.randomYaw ? FQuat{FVector::UpVector, FMath::DegreesToRadians(yaw)} : FQuat::Identity;
+        if (rule.alignToNormal)
+          rotation = FQuat::FindBetweenNormals(FVector::UpVector, normal) * rotation;
+
+        transforms.Emplace(rotation, FVector{location.X, location.Y, height}, FVector{scale});
+      }
+    }
   }
 
   //------------------------------------------------------------------------------
 
+  // Simplifies a chunk's (resolution+1)^2 height grid, resolution a power of two, into a right-triangulated
+  // irregular network: each right triangle is split at the midpoint of its hypotenuse only while the height there
+  // is off by more than maxError from the hypotenuse, or a split below needs it. Triangles are output as grid
+  // vertex indices, wound the same way as the full grid's.
+  //
+  // Chunk borders always keep every grid vertex, so neighboring chunks meet without cracks whatever their terrain.
   void
-  destroyChunksOutsideRadius(
-    TMap<FIntVector, AChunk*> &chunksLoaded, // will be removed from this map
-    const FVector2D center,
-    const float radius,
-    const float chunkSize)
+  triangulateWithinError(const TArray<float> &heights, const int32 resolution, const float maxError, TArray<int32> &outTriangles)
   {
-    auto chunkIsOutside = [=](const FIntVector chunk)
+    const int32 gridSize = resolution + 1;
+    const int32 numTriangles = resolution * resolution * 2 - 2; // in the full binary tree, excluding the two roots
+    const int32 numParentTriangles = numTriangles - resolution * resolution;
+
+    // the error of splitting each triangle, stored at the midpoint of its hypotenuse, which it shares with its
+    // neighbor across that hypotenuse; a split must include the splits of its children
+    TArray<float> errors;
+    errors.SetNumZeroed(gridSize * gridSize);
+
+    // force every split along the borders, and with that every split above them
+    for (int32 i = 0; i < gridSize; ++i)
     {
-      return (FVector2D{chunk.X*chunkSize, chunk.Y*chunkSize}-center).SizeSquared() > radius*radius;
-    };
+      errors[i] = errors[resolution * gridSize + i] = TNumericLimits<float>::Max();
+      errors[i * gridSize] = errors[i * gridSize + resolution] = TNumericLimits<float>::Max();
+    }
 
-    for( auto it = chunksLoaded.CreateIterator(); it; ++it )
-      if( chunkIsOutside(it.Key()))
+    // visit triangles from the smallest up, by walking each one's path from its root
+    for (int32 i = numTriangles - 1; i >= 0; --i)
+    {
+      int32 id = i + 2;
+      int32 ax = 0, ay = 0, bx = 0, by = 0, cx = 0, cy = 0;
+      if (id & 1)
+        bx = by = cx = resolution; // bottom-left root
+      else
+        ax = ay = cy = resolution; // top-right root
+
+      while ((id >>= 1) > 1)
       {
-        // it.Value()->RemoveFromRoot(); // not sure if I need to do this
-        it.Value()->Destroy();
-        it.RemoveCurrent();
+        const int32 mx = (ax + bx) >> 1;
+        const int32 my = (ay + by) >> 1;
+        if (id & 1)
+        {
+          bx = ax; by = ay;
+          ax = cx; ay = cy;
+        }
+        else
+        {
+          ax = bx; ay = by;
+          bx = cx; by = cy;
+        }
+        cx = mx; cy = my;
       }
-  }
 
-  //==============================================================================
-
-  class MeshGenerator : public FRunnable
-  {
-    std::mutex workMutex;
-    std::condition_variable workConditionVariable; // main notifies workers
-    std::deque<std::unique_ptr<GenerationWorkUnit>> workQueue; // lock before access
-    bool shouldStop{}; // set true then notify workConditionVariable then wait for worker to finish
+      const int32 mx = (ax + bx) >> 1;
+      const int32 my = (ay + by) >> 1;
+      const int32 middle = my * gridSize + mx;
 
-    std::mutex doneMutex;
-    TArray<std::unique_ptr<GenerationWorkUnit>> doneWork; // lock before access
+      float &error = errors[middle];
+      error = FMath::Max(error, FMath::Abs(0.5f * (heights[ay * gridSize + ax] + heights[by * gridSize + bx]) - heights[middle]));
 
-    FRunnableThread* thread;
+      // and the errors of its children, at the middles of the legs from the right angle corner c
+      if (i < numParentTriangles)
+        error = FMath::Max3(error,
+          errors[((ay + cy) >> 1) * gridSize + ((ax + cx) >> 1)],
+          errors[((by + cy) >> 1) * gridSize + ((bx + cx) >> 1)]);
+    }
 
-  public:
-    MeshGenerator()
-      : thread{FRunnableThread::Create(this, TEXT("MeshGeneratorThread"))}
-    {}
+    outTriangles.Reset();
 
-    ~MeshGenerator() override
+    // a and b end the hypotenuse, c is the right angle corner
+    auto addTriangle = [&](auto &self, const int32 ax, const int32 ay, const int32 bx, const int32 by, const int32 cx, const int32 cy) -> void
     {
-      if (thread)
+      const int32 mx = (ax + bx) >> 1;
+      const int32 my = (ay + by) >> 1;
+
+      if (FMath::Abs(ax - cx) + FMath::Abs(ay - cy) > 1 && errors[my * gridSize + mx] > maxError)
       {
-        thread->Kill(true);
-        delete thread;
+        self(self, cx, cy, ax, ay, mx, my);
+        self(self, bx, by, cx, cy, mx, my);
+        return;
       }
-    }
 
-    //------------------------------------------------------------------------------
-    // FRunnable
+      // the full grid's triangles turn clockwise in grid coordinates
+      const int32 a = ay * gridSize + ax, b = by * gridSize + bx, c = cy * gridSize + cx;
+      if ((bx - ax) * (cy - ay) - (by - ay) * (cx - ax) < 0)
+        outTriangles.Append({a, b, c});
+      else
+        outTriangles.Append({a, c, b});
+    };
 
-    // bool Init() override {}
+    addTriangle(addTriangle, 0, 0, resolution, resolution, resolution, 0);
+    addTriangle(addTriangle, resolution, resolution, 0, 0, 0, resolution);
+  }
 
-    uint32 Run() override
-    {
-      UE_LOG(LogTemp, Warning, TEXT("MeshGenerator::Run() starting"));
+  //------------------------------------------------------------------------------
 
-      MeshPointCache pointCache;
+  // Stage 1: heights, and their gradients for the mesh, at every vertex. Height and gradient come from the same
+  // source sample so no neighboring samples are needed. Compiled per height source, see visitHeightSource.
+  template<typename HeightSource>
+  void sampleChunk(GenerationWorkUnit &workUnit, const HeightSource &heightSource)
+  {
+    const int32 resolution = workUnit.parameters.resolution;
+    const float chunkSize = workUnit.parameters.size;
+    const float verticalScale = workUnit.parameters.verticalScale;
+    const float rNoiseScale = 1.f / workUnit.parameters.horizontalNoiseScale;
+    const float gradientScale = verticalScale * rNoiseScale; // noise gradient -> world height gradient
+    const bool withGradients = !workUnit.collisionOnly;
 
-      for (;;)
-      {
-        std::unique_ptr<GenerationWorkUnit> workUnit;
+    const FVector2D minCorner = chunkLocationMinCornerCoordinates(workUnit.chunkLocation, chunkSize);
 
-        {
-          std::unique_lock lock(workMutex);
-          workConditionVariable.wait(lock, [this] { return shouldStop || !workQueue.empty(); });
+    const float stepSize = chunkSize / resolution;
 
-          if (shouldStop)
-            break;
+    // height edits are resampled if they were made at a different resolution
+    const ChunkEdits *edits = workUnit.edits.Get();
+    const float editStep = edits ? float(edits->resolution) / resolution : 0.f; // one mesh step in edit grid units
+    const float rEditGradientStep = 0.5f / stepSize;
 
-          workUnit = std::move(workQueue.front());
-          workQueue.pop_front();
-        }
+    // a fresh heightfield each time since the previous one may still be shared with the query cache
+    const auto heightfield = MakeShared<ChunkHeightfield, ESPMode::ThreadSafe>();
+    heightfield->chunkLocation = workUnit.chunkLocation;
+    heightfield->parameters = workUnit.parameters;
+    heightfield->heights.Reset((resolution + 1) * (resolution + 1));
+
+    if (withGradients)
+      workUnit.gradients.Reset((resolution + 1) * (resolution + 1));
+    else
+      workUnit.gradients.Empty();
+
+    for (int32 y = 0; y <= resolution; ++y)
+    {
+      const float yNoisePos = (minCorner.Y + y * stepSize) * rNoiseScale;
+
+      for (int32 x = 0; x <= resolution; ++x)
+      {
+        const float xNoisePos = (minCorner.X + x * stepSize) * rNoiseScale;
 
-        // UE_LOG(LogTemp, Warning, TEXT("MeshGenerator::Run() generating mesh"));
-        generateMesh(*workUnit, pointCache);
+        const noise::NoiseSample sample = heightSource(xNoisePos, yNoisePos);
+        float z = verticalScale * sample.value;
+        FVector2D gradient = sample.gradient * gradientScale;
 
+        if (edits)
         {
-          std::lock_guard lock(doneMutex);
-          doneWork.Push(std::move(workUnit));
+          // edits are sparse, so their gradient is taken from neighboring edit samples rather than analytically
+          const float ex = x * editStep, ey = y * editStep;
+          z += edits->sample(ex, ey);
+          if (withGradients)
+          {
+            gradient.X += (edits->sample(ex + editStep, ey) - edits->sample(ex - editStep, ey)) * rEditGradientStep;
+            gradient.Y += (edits->sample(ex, ey + editStep) - edits->sample(ex, ey - editStep)) * rEditGradientStep;
+          }
         }
-      }
 
-      UE_LOG(LogTemp, Warning, TEXT("MeshGenerator::Run() stopping"));
-
-      return 0;
+        heightfield->heights.Add(z);
+        if (withGradients)
+          workUnit.gradients.Add(gradient);
+      }
     }
 
-    void Stop() override
+    workUnit.heightfield = heightfield;
+  }
+
+  // Stage 1 of volumetric chunks: density at every grid point of the chunk and of the ring of cells around it, so
+  // that the mesh stage can join the chunk's surface to its neighbors'. Density is positive in rock: the height
+  // source's height minus z, plus 3D noise of up to caveDepth within caveDepth of that height, which makes the
+  // overhangs and caves. Further from that height the noise can't change which side of the surface a point is on,
+  // so it is skipped there, and chunks entirely above or below that band are known to be air or rock from their
+  // column heights alone: they keep no densities and cost a fraction of a chunk with surface in it.
+  template<typename HeightSource>
+  void sampleVolume(GenerationWorkUnit &workUnit, const HeightSource &heightSource)
+  {
+    const int32 resolution = workUnit.parameters.resolution;
+    const int32 n = resolution + 2; // samples per axis, from one step below the chunk's min corner
+    const float chunkSize = workUnit.parameters.size;
+    const float stepSize = chunkSize / resolution;
+    const float verticalScale = workUnit.parameters.verticalScale;
+    const float rNoiseScale = 1.f / workUnit.parameters.horizontalNoiseScale;
+    const float caveDepth = workUnit.parameters.caveDepth;
+    const float rCaveScale = 1.f / workUnit.parameters.caveScale;
+
+    const FVector minCorner = chunkLocationMinCorner3D(workUnit.chunkLocation, chunkSize) - FVector{stepSize};
+
+    TArray<float> columnHeights;
+    columnHeights.SetNumUninitialized(n * n);
+    float minHeight = TNumericLimits<float>::Max(), maxHeight = TNumericLimits<float>::Lowest();
+
+    for (int32 y = 0, column = 0; y < n; ++y)
+      for (int32 x = 0; x < n; ++x, ++column)
+      {
+        const float height =
+          verticalScale * heightSource((minCorner.X + x * stepSize) * rNoiseScale, (minCorner.Y + y * stepSize) * rNoiseScale).value;
+        columnHeights[column] = height;
+        minHeight = FMath::Min(minHeight, height);
+        maxHeight = FMath::Max(maxHeight, height);
+      }
+
+    const float zMin = minCorner.Z, zMax = minCorner.Z + (n - 1) * stepSize;
+    if (maxHeight + caveDepth <= zMin || minHeight - caveDepth > zMax)
+    {
+      workUnit.densities.Reset();
+      return;
+    }
+
+    workUnit.densities.SetNumUninitialized(n * n * n);
+    float *density = workUnit.densities.GetData();
+
+    for (int32 z = 0; z < n; ++z)
+    {
+      const float worldZ = minCorner.Z + z * stepSize;
+
+      for (int32 y = 0, column = 0; y < n; ++y)
+        for (int32 x = 0; x < n; ++x, ++column)
+        {
+          float d = columnHeights[column] - worldZ;
+          if (FMath::Abs(d) <= caveDepth)
+          {
+            const FVector caveLocation = FVector{minCorner.X + x * stepSize, minCorner.Y + y * stepSize, worldZ} * rCaveScale;
+            d += caveDepth * FMath::Clamp(FMath::PerlinNoise3D(caveLocation), -1.f, 1.f);
+          }
+          *density++ = d;
+        }
+    }
+  }
+
+  void sampleChunk(GenerationWorkUnit &workUnit)
+  {
+    visitHeightSource(workUnit.parameters, workUnit.heightmap.Get(), [&](const auto &heightSource)
+    {
+      if (workUnit.parameters.volumetric)
+        sampleVolume(workUnit, heightSource);
+      else
+        sampleChunk(workUnit, heightSource);
+    });
+  }
+
+  //------------------------------------------------------------------------------
+
+  // Stage 2 of volumetric chunks, after sampleVolume: the surface between rock and air as a naive surface net, the
+  // simplest form of dual contouring. Every cell the surface crosses gets one vertex, at the mean of the crossings
+  // on its edges, and every grid edge the surface crosses gets a quad joining the four cells around it. A chunk
+  // makes the quads of the grid edges starting at its own grid points, using the ring of cells around it, so
+  // neighboring chunks meet without cracks or overlap; shared cells get the same vertex on both sides.
+  //
+  // Finding the crossed edges takes two passes over whole rows of flat arrays with no branches, which the compiler
+  // vectorizes; only grid points with a crossed edge, a thin sheet of the chunk, are visited one at a time.
+  void meshVolume(GenerationWorkUnit &workUnit)
+  {
+    auto &[vertices, triangles, normals, uv0, colors, tangents] = workUnit.meshData;
+
+    [](auto& ... object) { (object.Reset(), ...); }
+      (vertices, triangles, normals, uv0, colors, tangents);
+    workUnit.scatterTransforms.Reset();
+
+    if (workUnit.densities.IsEmpty())
+      return;
+
+    const int32 resolution = workUnit.parameters.resolution;
+    const int32 n = resolution + 2; // samples per axis
+    const int32 m = n - 1;          // cells per axis; cell x spans samples x and x + 1
+    const float stepSize = workUnit.parameters.size / resolution;
+    const FVector minCorner = chunkLocationMinCorner3D(workUnit.chunkLocation, workUnit.parameters.size);
+    const float *density = workUnit.densities.GetData();
+
+    // which samples are in rock
+    TArray<uint8> rock;
+    rock.SetNumUninitialized(n * n * n);
+    for (int32 i = 0; i < n * n * n; ++i)
+      rock[i] = density[i] > 0.f;
+
+    // which of the x, y and z edges starting at each of the chunk's own grid points the surface crosses, one bit each
+    TArray<uint8> crossings;
+    crossings.SetNumZeroed(n * n * n);
+    for (int32 z = 1; z <= resolution; ++z)
+      for (int32 y = 1; y <= resolution; ++y)
+      {
+        const int32 row = (z * n + y) * n;
+        const uint8 *r = &rock[row];
+        uint8 *out = &crossings[row];
+        for (int32 x = 1; x <= resolution; ++x)
+          out[x] = (r[x] ^ r[x + 1]) | (r[x] ^ r[x + n]) << 1 | (r[x] ^ r[x + n * n]) << 2;
+      }
+
+    // corners of a cell are numbered by their offsets as bits: x, y << 1, z << 2
+    static constexpr int32 cellEdges[12][2] = {
+      {0, 1}, {2, 3}, {4, 5}, {6, 7},
+      {0, 2}, {1, 3}, {4, 6}, {5, 7},
+      {0, 4}, {1, 5}, {2, 6}, {3, 7}};
+
+    TArray<int32> cellVertices;
+    cellVertices.Init(INDEX_NONE, m * m * m);
+
+    auto cellVertex = [&](const int32 x, const int32 y, const int32 z)
+    {
+      int32 &index = cellVertices[(z * m + y) * m + x];
+      if (index != INDEX_NONE)
+        return index;
+
+      float d[8];
+      for (int32 corner = 0; corner < 8; ++corner)
+        d[corner] = density[((z + (corner >> 2)) * n + y + ((corner >> 1) & 1)) * n + x + (corner & 1)];
+
+      FVector crossingSum{0.f};
+      int32 numCrossings = 0;
+      for (const auto &[a, b] : cellEdges)
+        if ((d[a] > 0.f) != (d[b] > 0.f))
+        {
+          const FVector cornerA(a & 1, (a >> 1) & 1, a >> 2), cornerB(b & 1, (b >> 1) & 1, b >> 2);
+          crossingSum += FMath::Lerp(cornerA, cornerB, d[a] / (d[a] - d[b]));
+          ++numCrossings;
+        }
+
+      // density grows into rock, so the surface faces down its gradient
+      const FVector gradient{
+        (d[1] - d[0]) + (d[3] - d[2]) + (d[5] - d[4]) + (d[7] - d[6]),
+        (d[2] - d[0]) + (d[3] - d[1]) + (d[6] - d[4]) + (d[7] - d[5]),
+        (d[4] - d[0]) + (d[5] - d[1]) + (d[6] - d[2]) + (d[7] - d[3])};
+      const FVector normal = (-gradient).GetSafeNormal(SMALL_NUMBER, FVector::UpVector);
+
+      const FVector location = (FVector(x - 1, y - 1, z - 1) + crossingSum / numCrossings) * stepSize;
+      const FVector worldLocation = minCorner + location;
+
+      // texture coordinates are projected along the normal's main axis, 1 meter per UV unit as on heightfield chunks
+      const FVector absNormal = normal.GetAbs();
+      const FVector2D uv =
+        absNormal.Z >= absNormal.X && absNormal.Z >= absNormal.Y ? FVector2D{worldLocation.X, worldLocation.Y}
+        : absNormal.X >= absNormal.Y ? FVector2D{worldLocation.Y, worldLocation.Z}
+        : FVector2D{worldLocation.X, worldLocation.Z};
+
+      index = vertices.Num();
+      vertices.Add(location);
+      normals.Add(normal);
+      uv0.Add(0.01f * uv);
+      colors.Emplace(1.f, 1.f, 1.f, 1.f);
+      tangents.Emplace((FVector::XAxisVector - normal.X * normal).GetSafeNormal(SMALL_NUMBER, FVector::YAxisVector), false);
+      return index;
+    };
+
+    for (int32 z = 1; z <= resolution; ++z)
+      for (int32 y = 1; y <= resolution; ++y)
+        for (int32 x = 1; x <= resolution; ++x)
+        {
+          const int32 sample = (z * n + y) * n + x;
+          if (!crossings[sample])
+            continue;
+
+          for (int32 axis = 0; axis < 3; ++axis)
+          {
+            if (!(crossings[sample] & (1 << axis)))
+              continue;
+
+            // the four cells around the edge, stepping back along the two other axes u and v, with u x v = axis
+            const int32 u = (axis + 1) % 3, v = (axis + 2) % 3;
+            auto cellAround = [&](const int32 du, const int32 dv)
+            {
+              int32 cell[3] = {x, y, z};
+              cell[u] -= du;
+              cell[v] -= dv;
+              return cellVertex(cell[0], cell[1], cell[2]);
+            };
+            const int32 c00 = cellAround(1, 1), c10 = cellAround(0, 1), c11 = cellAround(0, 0), c01 = cellAround(1, 0);
+
+            // wound like heightfield chunks, facing out of the rock along the edge
+            if (rock[sample])
+              triangles.Append({c00, c01, c11, c00, c11, c10});
+            else
+              triangles.Append({c00, c10, c11, c00, c11, c01});
+          }
+        }
+  }
+
+  //------------------------------------------------------------------------------
+
+  // Stage 2, after sampleChunk: render mesh and scattered props.
+  void meshChunk(GenerationWorkUnit &workUnit)
+  {
+    if (workUnit.parameters.volumetric)
+    {
+      meshVolume(workUnit);
+      return;
+    }
+
+    auto &[vertices, triangles, normals, uv0, colors, tangents] = workUnit.meshData;
+
+    scatterProps(workUnit);
+
+    if (workUnit.collisionOnly)
+    {
+      [](auto& ... object) { (object.Empty(), ...); }
+        (vertices, triangles, normals, uv0, colors, tangents);
+      return;
+    }
+
+    const int32 resolution = workUnit.parameters.resolution;
+    const float chunkSize = workUnit.parameters.size;
+    const FVector2D minCorner = chunkLocationMinCornerCoordinates(workUnit.chunkLocation, chunkSize);
+    const float stepSize = chunkSize / resolution;
+    const TArray<float> &heights = workUnit.heightfield->heights;
+
+    const FVector2D minCornerUV = 0.01f * minCorner;
+    const float uvStepSize = 0.01f * chunkSize / resolution; // 1 meter per texture UV unit
+
+    auto addVertex = [&](const int32 x, const int32 y)
+    {
+      const int32 index = y * (resolution + 1) + x;
+      const float z = heights[index];
+      const FVector2D gradient = workUnit.gradients[index];
+      const float dzdx = gradient.X, dzdy = gradient.Y;
+
+      // surface z = h(x,y): normal is (-dh/dx, -dh/dy, 1), tangent follows +U which runs along +x
+      vertices.Emplace(x * stepSize, y * stepSize, z);
+      normals.Emplace(FVector{-dzdx, -dzdy, 1.f}.GetUnsafeNormal());
+      uv0.Emplace(minCornerUV.X + x * uvStepSize, minCornerUV.Y + y * uvStepSize);
+      colors.Emplace(1.f, 1.f, 1.f, 1.f);
+      tangents.Emplace(FVector{1.f, 0.f, dzdx}.GetUnsafeNormal(), false);
+    };
+
+    if (workUnit.parameters.meshErrorTolerance > 0.f && FMath::IsPowerOfTwo(resolution) && resolution > 1)
+    {
+      // only the grid vertices the simplified triangles use are emitted
+      triangulateWithinError(heights, resolution, workUnit.parameters.meshErrorTolerance, triangles);
+
+      [](auto& ... object) { (object.Reset(), ...); }
+        (vertices, normals, uv0, colors, tangents);
+
+      TArray<int32> vertexIndices;
+      vertexIndices.Init(INDEX_NONE, (resolution + 1) * (resolution + 1));
+
+      for (int32 &index : triangles)
+      {
+        if (vertexIndices[index] == INDEX_NONE)
+        {
+          vertexIndices[index] = vertices.Num();
+          addVertex(index % (resolution + 1), index / (resolution + 1));
+        }
+        index = vertexIndices[index];
+      }
+
+      return;
+    }
+
+    // make arrays big enough to hold all vertices
+    [totalNumVertices=(resolution + 1) * (resolution + 1)]
+    (auto& ... object) { (object.Reset(totalNumVertices), ...); }
+      (vertices, normals, uv0, colors, tangents);
+
+    // set vertex values
+    for (int32 y = 0; y <= resolution; ++y)
+      for (int32 x = 0; x <= resolution; ++x)
+        addVertex(x, y);
+
+    // make triangles array big enough to hold all triangles
+    triangles.Reset(resolution * resolution * 2 * 3);
+
+    // set triangle indices
+    for (int32 y = 0, index = 0; y < resolution; ++y, ++index)
+        for (int32 x = 0; x < resolution; ++x, ++index)
+        {
+          triangles.Append({index, index + resolution + 1, index + 1});
+          triangles.Append({index + 1, index + resolution + 1, index + resolution + 2});
+        }
+  }
+
+  //------------------------------------------------------------------------------
+
+  // Stage 2, after sampleChunk and alongside meshChunk: heightfield collision.
+  void cookChunk(GenerationWorkUnit &workUnit)
+  {
+    LLM_SCOPE_BYTAG(ProceduralLandscape_Collision);
+    workUnit.collisionHeightfield =
+      makeChunkHeightfield(workUnit.heightfield->heights, workUnit.parameters.resolution, workUnit.parameters.size);
+  }
+
+  //------------------------------------------------------------------------------
+
+  void
+  destroyChunksOutsideRadius(
+    TMap<FIntVector, LoadedChunk> &chunksLoaded, // will be removed from this map
+    TArray<FIntVector> &chunksUnloaded, // and appended to this array
+    const TArrayView<const StreamingCenter> centers, // outside the radius of all of these
+    const float radius,
+    const float chunkSize)
+  {
+    auto chunkIsOutside = [=](const FIntVector chunk)
+    {
+      return distanceSquaredToNearest(chunk, centers, chunkSize) > radius*radius;
+    };
+
+    for( auto it = chunksLoaded.CreateIterator(); it; ++it )
+      if( chunkIsOutside(it.Key()))
+      {
+        // it.Value()->RemoveFromRoot(); // not sure if I need to do this
+        if (AChunk *actor = it.Value().actor) // volumetric chunks of only air or rock have none
+          actor->Destroy();
+        chunksUnloaded.Add(it.Key());
+        it.RemoveCurrent();
+      }
+  }
+
+  //==============================================================================
+
+  // One stage of the generation pipeline: runs queued jobs on the world's generation pool, at most maxConcurrency at a time.
+  class TaskStage
+  {
+    const UProceduralGenerationSubsystem::FPoolPtr pool;
+    std::mutex mutex;
+    std::condition_variable idleConditionVariable; // notified whenever a job finishes
+    std::deque<TUniqueFunction<void()>> pending; // lock before access
+    int32 running{};                             // lock before access
+    int32 maxConcurrency;                        // lock before access
+    bool stopped{};                              // lock before access
+    float priority{};                            // lock before access; for jobs launched from now on
+
+  public:
+    TaskStage(UProceduralGenerationSubsystem::FPoolPtr pool, const int32 maxConcurrency)
+      : pool{MoveTemp(pool)}, maxConcurrency{maxConcurrency}
+    {}
+
+    ~TaskStage()
+    {
+      stop();
+    }
+
+    void
+    setMaxConcurrency(const int32 newMaxConcurrency)
+    {
+      std::lock_guard lock(mutex);
+      maxConcurrency = FMath::Max(1, newMaxConcurrency);
+      launchReady_AssumesLocked();
+    }
+
+    void
+    setPriority(const float newPriority)
+    {
+      std::lock_guard lock(mutex);
+      priority = newPriority;
+    }
+
+    // jobs waiting or running
+    int32
+    getNumQueued()
+    {
+      std::lock_guard lock(mutex);
+      return int32(pending.size()) + running;
+    }
+
+    void
+    push(TUniqueFunction<void()> job, const bool urgent = false)
+    {
+      std::lock_guard lock(mutex);
+      if (stopped)
+        return;
+
+      if (urgent)
+        pending.push_front(MoveTemp(job));
+      else
+        pending.push_back(MoveTemp(job));
+
+      launchReady_AssumesLocked();
+    }
+
+    // drops pending jobs and waits for running ones to finish
+    void
+    stop()
+    {
+      std::unique_lock lock(mutex);
+      stopped = true;
+      pending.clear();
+      idleConditionVariable.wait(lock, [this] { return running == 0; });
+    }
+
+  private:
+    void
+    launchReady_AssumesLocked()
+    {
+      for (; !stopped && running < maxConcurrency && !pending.empty(); pending.pop_front())
+      {
+        ++running;
+        const bool submitted = pool->Submit([this, job = MoveTemp(pending.front())]() mutable
+        {
+          job();
+          job.Reset(); // release what the job holds before this stage can be stopped and destroyed
+
+          std::lock_guard lock(mutex);
+          --running;
+          launchReady_AssumesLocked();
+          idleConditionVariable.notify_all();
+        }, priority);
+
+        if (!submitted) // the pool stopped with its world; the job is dropped
+        {
+          --running;
+          idleConditionVariable.notify_all();
+        }
+      }
+    }
+  };
+
+  //==============================================================================
+
+  // Chunk generation as a graph of jobs on the world's shared generation pool:
+  //
+  //   sample ──┬── mesh ──┬── done (picked up by the game thread, which builds the static mesh and attaches it)
+  //            └── cook ──┘
+  //
+  // Each stage has its own concurrency, so independent chunks overlap across stages and cores.
+  // Volumetric chunks sample densities and mesh their surface in the same stages, and are never cooked.
+  // Cooking only runs for heightfield collision; triangle collision is cooked by the engine once the static mesh exists.
+  class GenerationPipeline
+  {
+    TaskStage sampleStage;
+    TaskStage meshStage;
+    TaskStage cookStage;
+
+    std::mutex doneMutex;
+    TArray<std::unique_ptr<GenerationWorkUnit>> doneWork; // lock before access
+
+    std::atomic<uint32> parametersVersion{}; // work units of other versions are passed through ungenerated
+
+    // a work unit shared by the stages after sampling, which write to disjoint parts of it
+    struct ChunkJob
+    {
+      std::unique_ptr<GenerationWorkUnit> workUnit;
+      std::atomic<int32> stagesLeft{};
+    };
+    using ChunkJobPtr = TSharedPtr<ChunkJob, ESPMode::ThreadSafe>;
+
+  public:
+    explicit GenerationPipeline(const UProceduralGenerationSubsystem::FPoolPtr &pool)
+      : sampleStage{pool, 2}, meshStage{pool, 2}, cookStage{pool, 2}
+    {}
+
+    ~GenerationPipeline()
+    {
+      // upstream first, since finishing jobs feed the stages after them
+      sampleStage.stop();
+      meshStage.stop();
+      cookStage.stop();
+    }
+
+    void
+    setConcurrency(const int32 sampleConcurrency, const int32 meshConcurrency, const int32 cookConcurrency)
+    {
+      sampleStage.setMaxConcurrency(sampleConcurrency);
+      meshStage.setMaxConcurrency(meshConcurrency);
+      cookStage.setMaxConcurrency(cookConcurrency);
+    }
+
+    void
+    setPriority(const float priority)
+    {
+      sampleStage.setPriority(priority);
+      meshStage.setPriority(priority);
+      cookStage.setPriority(priority);
+    }
+
+    // chunks waiting for or being sampled or meshed
+    int32
+    getNumQueued()
+    {
+      return sampleStage.getNumQueued() + meshStage.getNumQueued();
+    }
+
+    void
+    setParametersVersion(const uint32 version)
+    {
+      parametersVersion.store(version, std::memory_order_relaxed);
+    }
+
+    TArray<std::unique_ptr<GenerationWorkUnit>>
+    getCompletedWork(TArray<std::unique_ptr<GenerationWorkUnit>> emptyArray)
+    {
+      emptyArray.Reset(); // make sure it's empty
+      std::lock_guard lock(doneMutex);
+      return std::exchange(doneWork, std::move(emptyArray));
+    }
+
+    TArray<std::unique_ptr<GenerationWorkUnit>> // the same array but now empty
+    submitWorkToDo(TArray<std::unique_ptr<GenerationWorkUnit>> workUnits, const bool urgent = false)
+    {
+      // urgent work goes ahead of everything queued, keeping its relative order
+      for (int32 n = workUnits.Num(), i = 0; i < n; ++i)
+      {
+        std::unique_ptr<GenerationWorkUnit> &workUnit = workUnits[urgent ? n - 1 - i : i];
+        sampleStage.push([this, urgent, workUnit = std::move(workUnit)]() mutable
+        {
+          sample(std::move(workUnit), urgent);
+        }, urgent);
+      }
+
+      workUnits.Reset();
+      return std::move(workUnits);
+    }
+
+  private:
+    void
+    sample(std::unique_ptr<GenerationWorkUnit> workUnit, const bool urgent)
+    {
+      if (workUnit->parametersVersion != parametersVersion.load(std::memory_order_relaxed))
+      {
+        finish(std::move(workUnit));
+        return;
+      }
+
+      {
+        LLM_SCOPE_BYTAG(ProceduralLandscape_Generation);
+        sampleChunk(*workUnit);
+      }
+
+      // collision-only chunks always get heightfield collision, having no mesh to cook triangles from
+      const bool cook = workUnit->withCollision
+        && (workUnit->collisionMode == ELandscapeCollisionMode::Heightfield || workUnit->collisionOnly);
+
+      const ChunkJobPtr job = MakeShared<ChunkJob, ESPMode::ThreadSafe>();
+      job->workUnit = std::move(workUnit);
+      job->stagesLeft = cook ? 2 : 1;
+
+      meshStage.push([this, job]
+      {
+        LLM_SCOPE_BYTAG(ProceduralLandscape_Generation);
+        meshChunk(*job->workUnit);
+        finishStage(job);
+      }, urgent);
+
+      if (cook)
+        cookStage.push([this, job]
+        {
+          cookChunk(*job->workUnit);
+          finishStage(job);
+        }, urgent);
+    }
+
+    void
+    finishStage(const ChunkJobPtr &job)
+    {
+      if (--job->stagesLeft == 0)
+        finish(std::move(job->workUnit));
+    }
+
+    void
+    finish(std::unique_ptr<GenerationWorkUnit> workUnit)
+    {
+      std::lock_guard lock(doneMutex);
+      doneWork.Push(std::move(workUnit));
+    }
+  };
+
+  //==============================================================================
+
+  // Scales generation up while frames have time to spare and work is waiting, and down while frames run over.
+  //
+  // Settings sit on a ladder, one step changed at a time:
+  //   minimum concurrency at low priority, then normal priority from minimum to maximum concurrency,
+  //   then maximum concurrency at high priority.
+  // Frame time is smoothed, going down needs it over the target but going up needs it well under, and every step
+  // is held for a while, so the controller settles instead of oscillating around the target.
+  class ConcurrencyController
+  {
+    float smoothedFrameMs{};
+    float secondsSinceStep{};
+    int32 step = -1; // -1 until the first update, which starts at maximum concurrency and normal priority
+    int32 minConcurrency = 1, maxConcurrency = 1;
+
+    static constexpr float smoothingSeconds = 0.5f;
+    static constexpr float holdSeconds = 1.f;
+    static constexpr float headroom = 0.75f; // fraction of the target frame time under which generation may scale up
+
+  public:
+    void
+    update(
+      const float deltaSeconds,
+      const float frameMs,          // of the slower of the game and render threads, without idle time
+      const float targetFrameMs,
+      const int32 numQueued,        // chunks waiting in the pipeline
+      const int32 newMaxConcurrency)
+    {
+      maxConcurrency = FMath::Max(minConcurrency, newMaxConcurrency);
+      const int32 lastStep = maxConcurrency - minConcurrency + 2;
+
+      if (step < 0)
+      {
+        smoothedFrameMs = frameMs;
+        step = lastStep - 1;
+      }
+      step = FMath::Clamp(step, 0, lastStep);
+
+      smoothedFrameMs += (frameMs - smoothedFrameMs) * (1.f - FMath::Exp(-deltaSeconds / smoothingSeconds));
+      secondsSinceStep += deltaSeconds;
+
+      if (secondsSinceStep < holdSeconds)
+        return;
+
+      if (smoothedFrameMs > targetFrameMs && step > 0)
+        --step;
+      else if (smoothedFrameMs < targetFrameMs * headroom && numQueued > getConcurrency() && step < lastStep)
+        ++step;
+      else
+        return;
+
+      secondsSinceStep = 0.f;
+    }
+
+    // the same for every stage, before each stage's own limit
+    int32
+    getConcurrency() const
+    {
+      return FMath::Clamp(minConcurrency + step - 1, minConcurrency, maxConcurrency);
+    }
+
+    // in the world's generation queue, relative to other generation work
+    float
+    getPriority() const
+    {
+      if (step <= 0)
+        return -1.f;
+      if (step > maxConcurrency - minConcurrency + 1)
+        return 1.f;
+      return 0.f;
+    }
+  };
+
+  //==============================================================================
+  
+  struct ProceduralLandscapeProperties
+  {
+    UMaterialInterface *LandscapeMaterial{};
+  };
+
+  //==============================================================================
+
+  struct UnusedWorkUnits
+  {
+    TArray<std::unique_ptr<GenerationWorkUnit>> unusedWorkUnits;
+
+    std::unique_ptr<GenerationWorkUnit>
+    getUnusedWorkUnit()
+    {
+      if (unusedWorkUnits.IsEmpty())
+      {
+        LLM_SCOPE_BYTAG(ProceduralLandscape_Generation);
+        return std::make_unique<GenerationWorkUnit>();
+      }
+
+      return unusedWorkUnits.Pop(false);
+    };
+
+    void
+    putUnusedWorkUnit(std::unique_ptr<GenerationWorkUnit> workUnit)
+    {
+      workUnit->edits.Reset(); // release the snapshot so that edits to this chunk need not copy it
+      workUnit->heightfield.Reset();
+      workUnit->collisionHeightfield.Reset();
+      workUnit->scatterRules.Reset();
+      workUnit->heightmap.Reset();
+      workUnit->collisionUpdate = false;
+      unusedWorkUnits.Push(std::move(workUnit));
+    }
+
+    SIZE_T
+    unusedWorkUnitBytes() const
+    {
+      SIZE_T bytes = unusedWorkUnits.GetAllocatedSize();
+      for (const auto &workUnit : unusedWorkUnits)
+        bytes += allocatedBytes(*workUnit);
+      return bytes;
+    }
+  };
+} // namespace
+
+//==============================================================================
+
+struct AProceduralLandscape::Private : UnusedWorkUnits
+{
+  ProceduralLandscapeProperties properties{};
+  
+  TArray<StreamingCenter> streamingCenters; // chunks are loaded around each of these
+  TArray<FIntVector> chunksInRadius_array; // order matters
+  TArray<FIntVector> chunksInRadiusOfCenter_array;
+  TMap<FIntVector, float> chunksInRadius_priorities;
+  SphereOffsetsCache sphereOffsets; // of volumetric chunks
+  
+  TArray<std::unique_ptr<GenerationWorkUnit>> chunksToGenerate;            // order matters
+  TArray<std::unique_ptr<GenerationWorkUnit>> chunksGenerated;             // order matters
+  TArray<std::unique_ptr<GenerationWorkUnit>> chunksGeneratedAndInRadius;  // order matters; still loading until spawned
+  
+  TSet<FIntVector> chunksLoading;       // presence matters
+  TMap<FIntVector, LoadedChunk> chunksLoaded;  // presence matters
+  TArray<FIntVector> chunksUnloaded;
+
+  std::unique_ptr<GenerationPipeline> pipeline; // from the first tick, once there is a world to share generation with
+  ConcurrencyController concurrencyController;
+
+  // terrain edits
+  TMap<FIntVector, ChunkEditsPtr> chunkEdits; // sparse: only chunks that have been edited
+  int32 editResolution{}; // grid resolution shared by all chunk edits, fixed by the first edit
+  TSet<FIntVector> chunksEdited;    // edits changed since the chunk was last meshed
+  TSet<FIntVector> chunksRemeshing; // presence matters; from submission until the result is swapped in or discarded
+  TArray<std::unique_ptr<GenerationWorkUnit>> chunksToRemesh;
+  TArray<std::unique_ptr<GenerationWorkUnit>> chunksRemeshed; // order matters; waiting to be swapped in
+
+  // saved terrain edits, with bPersistEdits; a chunk's saved edits are loaded before it is generated, and it is
+  // saved and forgotten when the chunk unloads, so that only edits near streaming centers are kept in memory
+  TWeakObjectPtr<UChunkStorage> editStorage;
+  const UObject *editOwner{}; // the landscape; loads are dropped once it is destroyed
+  FName editChannel;
+  uint32 editEpoch{};             // bumped when edits are cleared, so that loads queued before then are ignored
+  TSet<FIntVector> editsLoaded;   // presence matters: their saved edits, if any, are in chunkEdits
+  TSet<FIntVector> editsLoading;  // presence matters
+  TSet<FIntVector> editsUnsaved;  // changed since last saved
+
+  // height queries; these may come from any thread, everything below is guarded by queryLock
+  // and so are chunkEdits and the contents of the edits they point to
+  mutable FRWLock queryLock;
+  TMap<FIntVector, ChunkHeightfieldPtr> heightfields; // of loaded chunks
+  TerrainParameters queryParameters{};
+  TiledHeightmapPtr queryHeightmap; // of queryParameters
+
+  ScatterRulesPtr scatterRules; // from ScatterLayers, replaced when they change
+
+  // the heightmap height source's file, opened while HeightmapFile names it
+  FString heightmapFile;
+  TiledHeightmapPtr heightmap;
+  uint32 heightmapId{};
+
+  // a heightmap imported over the file in use is read from where it was written, and moved into place once work
+  // still reading the heightmap it replaced is done with it
+  FString heightmapImportTarget; // full path
+  TWeakPtr<const FTiledHeightmap, ESPMode::ThreadSafe> replacedHeightmap;
+  uint32 nextHeightmapId{1};
+
+  // terrain parameter changes; chunks and work units are stamped with the version they were generated for
+  TerrainParameters generationParameters{};
+  uint32 parametersVersion{};
+  TArray<FIntVector> chunksToRegenerate_array;
+
+  // height virtual texture, while its pages are produced from height queries
+  URuntimeVirtualTexture *heightVirtualTexture{};
+  FHeightfieldVirtualTextureProducer *heightProducer{}; // owned by the virtual texture system; render thread only
+  FTransform heightVolumeToWorld;
+
+  TSet<FIntVector> chunksCompiling; // loaded chunks whose static meshes are still being built by the engine
+
+  // memory budget state
+  float budgetRadius = TNumericLimits<float>::Max(); // no chunks are loaded beyond this while memory is tight
+  SIZE_T loadedChunkBytes{};
+  SIZE_T unevictableBytes{}; // of edits, which are kept however tight memory is
+  SIZE_T estimatedMemoryUsage{};
+  bool warnedEditsOverBudget{};
+
+  void
+  updateMemoryStats()
+  {
+    SIZE_T meshBytes = 0, collisionBytes = 0, heightfieldBytes = 0;
+    for (const auto &loadedChunk : chunksLoaded)
+    {
+      meshBytes += loadedChunk.Value.meshBytes;
+      collisionBytes += loadedChunk.Value.collisionBytes;
+      heightfieldBytes += loadedChunk.Value.heightfieldBytes;
+    }
+    const SIZE_T poolBytes = unusedWorkUnitBytes();
+    SIZE_T editBytes = chunkEdits.GetAllocatedSize();
+    for (const auto &edits : chunkEdits)
+      editBytes += allocatedBytes(*edits.Value);
+
+    loadedChunkBytes = meshBytes + collisionBytes + heightfieldBytes;
+    unevictableBytes = editBytes;
+    estimatedMemoryUsage = loadedChunkBytes + poolBytes + editBytes;
+
+    SET_MEMORY_STAT(STAT_ProceduralLandscape_MeshMemory, meshBytes);
+    SET_MEMORY_STAT(STAT_ProceduralLandscape_CollisionMemory, collisionBytes);
+    SET_MEMORY_STAT(STAT_ProceduralLandscape_PoolMemory, poolBytes);
+    SET_MEMORY_STAT(STAT_ProceduralLandscape_EditMemory, editBytes);
+    SET_MEMORY_STAT(STAT_ProceduralLandscape_HeightfieldMemory, heightfieldBytes);
+    SET_DWORD_STAT(STAT_ProceduralLandscape_LoadedChunks, chunksLoaded.Num());
+  }
+
+  void
+  enforceMemoryBudget(const SIZE_T budgetBytes, const TArrayView<const StreamingCenter> centers, const float chunkSize)
+  {
+    updateMemoryStats();
+
+    if (budgetBytes == 0)
+    {
+      budgetRadius = TNumericLimits<float>::Max();
+      return;
+    }
+
+    // edits can't be evicted, so chunks and pooled work units get what they leave of the budget; unloading
+    // every chunk would not make up for edits that alone exceed it
+    if (unevictableBytes >= budgetBytes)
+    {
+      if (!warnedEditsOverBudget)
+        UE_LOG(LogTemp, Warning, TEXT("AProceduralLandscape: terrain edits alone take %.1f MB, more than MemoryBudgetMB"),
+          unevictableBytes / (1024. * 1024.));
+      warnedEditsOverBudget = true;
+      budgetRadius = TNumericLimits<float>::Max();
+      return;
+    }
+    warnedEditsOverBudget = false;
+
+    const SIZE_T evictableBudget = budgetBytes - unevictableBytes;
+    SIZE_T evictableBytes = estimatedMemoryUsage - unevictableBytes;
+
+    if (evictableBytes <= evictableBudget)
+    {
+      // relax the load limit one ring of chunks at a time once there is comfortable headroom again
+      if (budgetRadius < TNumericLimits<float>::Max() && evictableBytes < evictableBudget / 10 * 9)
+        budgetRadius += chunkSize;
+      return;
+    }
+
+    // cheapest first: drop pooled work units, they are reallocated on demand
+    evictableBytes -= unusedWorkUnitBytes();
+    unusedWorkUnits.Empty();
+
+    if (evictableBytes <= evictableBudget)
+    {
+      updateMemoryStats();
+      return;
+    }
+
+    // then unload the chunks furthest from any center until usage fits the budget, or there are none left
+    auto distanceSquaredTo = [=](const FIntVector chunk)
+    {
+      return distanceSquaredToNearest(chunk, centers, chunkSize);
+    };
+
+    chunksLoaded.KeySort([&](const FIntVector a, const FIntVector b) { return distanceSquaredTo(a) > distanceSquaredTo(b); });
+
+    for (auto it = chunksLoaded.CreateIterator(); it && evictableBytes > evictableBudget; ++it)
+    {
+      const LoadedChunk &loadedChunk = it.Value();
+      evictableBytes -= loadedChunk.meshBytes + loadedChunk.collisionBytes + loadedChunk.heightfieldBytes;
+      budgetRadius = FMath::Min(budgetRadius, FMath::Sqrt(distanceSquaredTo(it.Key())) - 0.5f * chunkSize);
+      if (loadedChunk.actor)
+        loadedChunk.actor->Destroy();
+      chunksUnloaded.Add(it.Key());
+      it.RemoveCurrent();
+    }
+
+    forgetUnloadedHeightfields();
+    updateMemoryStats();
+  }
+
+  //------------------------------------------------------------------------------
+
+  void
+  setHeightfield(LoadedChunk &loadedChunk, ChunkHeightfieldPtr heightfield)
+  {
+    loadedChunk.heightfieldBytes = allocatedBytes(*heightfield);
+
+    FRWScopeLock lock(queryLock, SLT_Write);
+    heightfields.Add(heightfield->chunkLocation, MoveTemp(heightfield));
+  }
+
+  void
+  forgetUnloadedHeightfields()
+  {
+    if (chunksUnloaded.IsEmpty())
+      return;
+
+    {
+      FRWScopeLock lock(queryLock, SLT_Write);
+      for (const FIntVector chunk : chunksUnloaded)
+        heightfields.Remove(chunk);
+    }
+    releaseUnloadedEdits();
+    chunksUnloaded.Reset();
+  }
+
+  //------------------------------------------------------------------------------
+  // saved terrain edits
+
+  // Whether the chunk's saved edits are in chunkEdits, starting to load them if not. Always while not persisting.
+  bool
+  areEditsLoaded(const FIntVector chunk)
+  {
+    UChunkStorage *storage = editStorage.Get();
+    if (!storage || editsLoaded.Contains(chunk))
+      return true;
+
+    bool alreadyLoading = false;
+    editsLoading.Add(chunk, &alreadyLoading);
+    if (!alreadyLoading)
+      storage->Load(editChannel, chunk, editOwner,
+        [this, chunk, epoch = editEpoch](TArray<uint8> &&data)
+        {
+          if (epoch != editEpoch)
+            return;
+          editsLoading.Remove(chunk);
+          editsLoaded.Add(chunk);
+          mergeLoadedEdits(chunk, data);
+        });
+
+    return false;
+  }
+
+  // Edits made to the chunk while its saved edits were loading (by brushes reaching across its border) are added
+  // on top of them, and saved edits on another grid resolution are resampled onto the current one.
+  void
+  mergeLoadedEdits(const FIntVector chunk, const TArray<uint8> &data)
+  {
+    if (data.IsEmpty())
+      return;
+
+    const float chunkSize = generationParameters.size;
+    ChunkEditsPtr loaded = deserializeEdits(data, chunkSize);
+    if (!loaded)
+    {
+      UE_LOG(LogTemp, Warning, TEXT("AProceduralLandscape: saved edits of chunk {%d, %d} discarded, damaged or for another chunk size"),
+        chunk.X, chunk.Y);
+      return;
+    }
+
+    FRWScopeLock lock(queryLock, SLT_Write);
+
+    if (!editResolution)
+      editResolution = loaded->resolution;
+
+    ChunkEditsPtr &edits = chunkEdits.FindOrAdd(chunk);
+    if (!edits && loaded->resolution == editResolution)
+      edits = MoveTemp(loaded);
+    else
+    {
+      if (!edits)
+        edits = MakeShared<ChunkEdits, ESPMode::ThreadSafe>(editResolution);
+      else if (!edits.IsUnique()) // copy on write: a worker is meshing a snapshot of these edits
+        edits = MakeShared<ChunkEdits, ESPMode::ThreadSafe>(*edits);
+
+      const float scale = float(loaded->resolution) / editResolution;
+      for (int32 y = -1; y <= editResolution + 1; ++y)
+        for (int32 x = -1; x <= editResolution + 1; ++x)
+          edits->at(x, y) += loaded->sample(x * scale, y * scale);
+
+      editsUnsaved.Add(chunk);
+    }
+
+    if (chunksLoaded.Contains(chunk))
+      chunksEdited.Add(chunk);
+
+    const FVector2D minCorner = chunkLocationMinCornerCoordinates(chunk, chunkSize);
+    invalidateHeightPages(minCorner, minCorner + FVector2D{chunkSize, chunkSize});
+  }
+
+  // Chunks whose saved edits are still loading keep their unsaved edits until merged, so that saving them cannot
+  // replace saved edits that have not been merged yet.
+  void
+  saveEdits(UChunkStorage &storage, const FIntVector chunk)
+  {
+    if (editsLoading.Contains(chunk) || !editsUnsaved.Remove(chunk))
+      return;
+
+    const ChunkEditsPtr *edits = chunkEdits.Find(chunk);
+    storage.Save(editChannel, chunk, edits ? serializeEdits(**edits, generationParameters.size) : TArray<uint8>{}, editOwner,
+      [this, chunk, epoch = editEpoch](const bool saved)
+      {
+        if (saved || epoch != editEpoch)
+          return;
+
+        // saved again when the chunk unloads, if its edits are still here to save
+        if (editsLoaded.Contains(chunk))
+          editsUnsaved.Add(chunk);
+        else
+          UE_LOG(LogTemp, Error, TEXT("AProceduralLandscape: edits of chunk {%d, %d} couldn't be saved, and are lost"), chunk.X, chunk.Y);
+      });
+  }
+
+  // Saved edits still loading are waited for and merged first, so that their chunks' unsaved edits are saved too.
+  void
+  saveAllEdits()
+  {
+    UChunkStorage *storage = editStorage.Get();
+    if (!storage)
+      return;
+
+    if (!editsLoading.IsEmpty())
+      storage->Flush();
+
+    for (const FIntVector chunk : editsUnsaved.Array())
+      saveEdits(*storage, chunk);
+  }
+
+  // Saves the edits of chunks that just unloaded and forgets them; terrain queries there fall back to the
+  // procedural height until the chunks stream back in. Chunks still loading their saved edits are kept.
+  void
+  releaseUnloadedEdits()
+  {
+    UChunkStorage *storage = editStorage.Get();
+    if (!storage)
+      return;
+
+    FRWScopeLock lock(queryLock, SLT_Write);
+    for (const FIntVector chunk : chunksUnloaded)
+      if (editsLoaded.Remove(chunk))
+      {
+        saveEdits(*storage, chunk);
+        chunksEdited.Remove(chunk);
+        if (chunkEdits.Remove(chunk))
+        {
+          const FVector2D minCorner = chunkLocationMinCornerCoordinates(chunk, generationParameters.size);
+          invalidateHeightPages(minCorner, minCorner + FVector2D{generationParameters.size, generationParameters.size});
+        }
+      }
+  }
+
+  // After edits were discarded, so are saved ones along with loads still on their way.
+  void
+  clearSavedEdits()
+  {
+    if (UChunkStorage *storage = editStorage.Get())
+      storage->ClearChannel(editChannel);
+
+    ++editEpoch;
+    editsLoading.Reset();
+    editsUnsaved.Reset();
+  }
+
+  void
+  setQueryParameters(const TerrainParameters &parameters)
+  {
+    if (FMemory::Memcmp(&parameters, &queryParameters, sizeof(TerrainParameters)) != 0)
+    {
+      FRWScopeLock lock(queryLock, SLT_Write);
+      queryParameters = parameters;
+      queryHeightmap = heightmap;
+    }
+  }
+
+  // Switches to a just imported heightmap without touching the file it replaces, which work in flight may be reading.
+  void
+  swapInImportedHeightmap(const FString &tiledFile)
+  {
+    heightmapImportTarget = FPaths::ConvertRelativePathToFull(tiledFile);
+    replacedHeightmap = heightmap;
+
+    heightmapFile = tiledFile;
+    heightmap = FTiledHeightmap::Open(FTiledHeightmap::GetImportedFilename(heightmapImportTarget));
+    heightmapId = heightmap ? nextHeightmapId++ : 0;
+  }
+
+  // The landscape's terrain parameters, after opening HeightmapFile again if it changed since the last call.
+  TerrainParameters
+  currentTerrainParameters(const AProceduralLandscape &landscape)
+  {
+    if (!heightmapImportTarget.IsEmpty() && !replacedHeightmap.IsValid())
+    {
+      if (!FTiledHeightmap::FinishImport(heightmapImportTarget))
+        UE_LOG(LogTemp, Warning, TEXT("AProceduralLandscape: imported heightmap left beside %s until it is next opened"), *heightmapImportTarget);
+      heightmapImportTarget.Reset();
+    }
+
+    if (landscape.HeightmapFile.FilePath != heightmapFile)
+    {
+      heightmapFile = landscape.HeightmapFile.FilePath;
+      heightmap = heightmapFile.IsEmpty() ? nullptr : FTiledHeightmap::Open(FPaths::ConvertRelativePathToFull(heightmapFile));
+      heightmapId = heightmap ? nextHeightmapId++ : 0;
+    }
+
+    TerrainParameters parameters = getTerrainParameters(landscape);
+    parameters.heightmapId = heightmapId;
+    return parameters;
+  }
+
+  // Height, and optionally normal, at a world location. Reads the heightfield of the loaded chunk there,
+  // otherwise evaluates the procedural height plus edits directly. Caller holds queryLock for reading.
+  float
+  queryHeight_AssumesLocked(const FVector2D location, FVector *normal) const
+  {
+    const TerrainParameters &parameters = queryParameters;
+    const FIntVector chunk{
+      FMath::FloorToInt(location.X / parameters.size + 0.5f),
+      FMath::FloorToInt(location.Y / parameters.size + 0.5f),
+      0};
+
+    const FVector2D localLocation = location - chunkLocationMinCornerCoordinates(chunk, parameters.size);
+
+    if (const ChunkHeightfieldPtr *heightfield = heightfields.Find(chunk))
+      if ((*heightfield)->parameters.size == parameters.size)
+        return (*heightfield)->sample(localLocation, normal);
+
+    const noise::NoiseSample sample = sampleBaseHeightAndGradient(parameters, queryHeightmap.Get(), location);
+    float height = sample.value;
+    FVector2D gradient = sample.gradient;
+
+    if (const ChunkEditsPtr *editsPtr = chunkEdits.Find(chunk))
+    {
+      const ChunkEdits &edits = **editsPtr;
+      const float step = parameters.size / edits.resolution;
+      const float ex = localLocation.X / step, ey = localLocation.Y / step;
+      height += edits.sample(ex, ey);
+      gradient.X += (edits.sample(ex + 1.f, ey) - edits.sample(ex - 1.f, ey)) * 0.5f / step;
+      gradient.Y += (edits.sample(ex, ey + 1.f) - edits.sample(ex, ey - 1.f)) * 0.5f / step;
+    }
+
+    if (normal)
+      *normal = FVector{-gradient.X, -gradient.Y, 1.f}.GetUnsafeNormal();
+
+    return height;
+  }
+
+  //------------------------------------------------------------------------------
+
+  // Starts a new parameters version when the terrain parameters differ from those of the current one.
+  // Loaded chunks are then regenerated in place, except after a chunk size change or a switch between heightfield
+  // and volumetric chunks: chunk coordinates no longer mean the same place, so every chunk is unloaded and streamed
+  // in again, and after a chunk size change edits are dropped.
+  void
+  updateParametersVersion(const TerrainParameters &parameters)
+  {
+    if (FMemory::Memcmp(&parameters, &generationParameters, sizeof(TerrainParameters)) == 0)
+      return;
+
+    const bool chunkSizeChanged = parameters.size != generationParameters.size && parametersVersion != 0;
+    const bool chunkGridChanged = chunkSizeChanged || (parameters.volumetric != generationParameters.volumetric && parametersVersion != 0);
+
+    generationParameters = parameters;
+    pipeline->setParametersVersion(++parametersVersion);
+
+    if (!chunkGridChanged)
+      return;
+
+    for (const auto &loadedChunk : chunksLoaded)
+    {
+      if (loadedChunk.Value.actor)
+        loadedChunk.Value.actor->Destroy();
+      chunksUnloaded.Add(loadedChunk.Key);
+    }
+    chunksLoaded.Reset();
+    forgetUnloadedHeightfields();
+
+    if (!chunkSizeChanged)
+      return;
+
+    if (!chunkEdits.IsEmpty())
+    {
+      UE_LOG(LogTemp, Warning, TEXT("AProceduralLandscape: chunk size changed, terrain edits discarded"));
+      FRWScopeLock lock(queryLock, SLT_Write);
+      chunkEdits.Empty();
+      editResolution = 0;
+    }
+    chunksEdited.Reset();
+    clearSavedEdits();
+  }
+
+  // Queues regeneration of loaded chunks behind the current parameters version, nearest first, ahead of new chunks.
+  // The new meshes are swapped in place like edited chunks, at most MaxChunkRebuildsPerTick per frame, so no more
+  // are queued while maxRemeshing chunks are already remeshing or waiting to be swapped in; the rest follow later.
+  template<typename MakeWorkUnit>
+  void
+  regenerateStaleChunks(
+    const TArrayView<const StreamingCenter> centers, const float chunkSize, const int32 maxRemeshing, MakeWorkUnit &&makeWorkUnit)
+  {
+    if (chunksRemeshing.Num() >= maxRemeshing)
+      return;
+
+    chunksToRegenerate_array.Reset();
+    for (const auto &loadedChunk : chunksLoaded)
+      if (loadedChunk.Value.parametersVersion != parametersVersion && !chunksRemeshing.Contains(loadedChunk.Key))
+        chunksToRegenerate_array.Add(loadedChunk.Key);
+
+    if (chunksToRegenerate_array.IsEmpty())
+      return;
+
+    chunksToRegenerate_array.Sort([=](const FIntVector a, const FIntVector b)
+    {
+      return distanceSquaredToNearest(a, centers, chunkSize) < distanceSquaredToNearest(b, centers, chunkSize);
+    });
+
+    for (const FIntVector chunk : chunksToRegenerate_array)
+    {
+      if (chunksRemeshing.Num() >= maxRemeshing)
+        break;
+
+      std::unique_ptr<GenerationWorkUnit> workUnit = makeWorkUnit(chunk, chunksLoaded[chunk]);
+      workUnit->remesh = true;
+      chunksRemeshing.Add(chunk);
+      chunksToRemesh.Push(std::move(workUnit));
+    }
+  }
+
+  //------------------------------------------------------------------------------
+
+  void
+  startHeightVirtualTexture(URuntimeVirtualTexture *virtualTexture, const FBox &bounds)
+  {
+    if (virtualTexture->GetMaterialType() != ERuntimeVirtualTextureMaterialType::WorldHeight)
+    {
+      UE_LOG(LogTemp, Warning, TEXT("AProceduralLandscape: HeightVirtualTexture %s is not a world height virtual texture"),
+        *virtualTexture->GetName());
+      return;
+    }
+
+    heightVirtualTexture = virtualTexture;
+    heightVolumeToWorld = FTransform{FQuat::Identity, bounds.Min, bounds.GetSize()};
+
+    FVTProducerDescription producerDesc;
+    virtualTexture->GetProducerDescription(producerDesc, URuntimeVirtualTexture::FInitSettings{}, heightVolumeToWorld);
+
+    // answered by the same cached heightfields and noise as height queries, so pages match the chunk meshes
+    FHeightfieldSampler sampler = [this](const FVector2D location, FVector *normal)
+    {
+      FRWScopeLock lock(queryLock, SLT_ReadOnly);
+      return queryHeight_AssumesLocked(location, normal);
+    };
+
+    heightProducer = new FHeightfieldVirtualTextureProducer(producerDesc, heightVolumeToWorld, MoveTemp(sampler));
+    virtualTexture->Initialize(heightProducer, producerDesc, heightVolumeToWorld, bounds);
+  }
+
+  void
+  stopHeightVirtualTexture()
+  {
+    if (!heightVirtualTexture)
+      return;
+
+    heightVirtualTexture->Release();
+    heightVirtualTexture = nullptr;
+    heightProducer = nullptr;
+
+    // the producer is destroyed on the render thread and queries this object until then
+    FlushRenderingCommands();
+  }
+
+  // makes the height virtual texture produce pages over a world area again, after its heights have changed; the
+  // producer's own pages there are filled again too, since the renderer takes them as they are when it asks again
+  void
+  invalidateHeightPages(const FVector2D worldMin, const FVector2D worldMax)
+  {
+    if (!heightVirtualTexture)
+      return;
+
+    const FVector uvMin = heightVolumeToWorld.InverseTransformPosition(FVector{worldMin, 0.f});
+    const FVector uvMax = heightVolumeToWorld.InverseTransformPosition(FVector{worldMax, 0.f});
+
+    // queued before the producer's destruction, which Release queues, so it is still there when this runs
+    ENQUEUE_RENDER_COMMAND(InvalidateHeightPages)(
+      [producer = heightProducer, allocatedVirtualTexture = heightVirtualTexture->GetAllocatedVirtualTexture(),
+        uv0 = FVector2D{uvMin}.ClampAxes(0.f, 1.f), uv1 = FVector2D{uvMax}.ClampAxes(0.f, 1.f)](FRHICommandListImmediate&)
+      {
+        producer->Invalidate(uv0, uv1);
+        if (allocatedVirtualTexture)
+          GetRendererModule().FlushVirtualTextureCache(allocatedVirtualTexture, uv0, uv1);
+      });
+  }
+
+  //------------------------------------------------------------------------------
+
+  // Fits generation to the frame time the game and render threads leave over, within the stage limits, or applies
+  // the stage limits as they are when adaptive concurrency is off.
+  void
+  updateConcurrency(const AProceduralLandscape &landscape)
+  {
+    const int32 numQueued = pipeline->getNumQueued();
+    int32 concurrency = TNumericLimits<int32>::Max();
+    float priority = 0.f;
+
+    if (landscape.bAdaptiveConcurrency)
     {
-      shouldStop = true;
-      workConditionVariable.notify_all();
+      const float frameMs = FPlatformTime::ToMilliseconds(FMath::Max(GGameThreadTime, GRenderThreadTime));
+      concurrencyController.update(
+        float(FApp::GetDeltaTime()), frameMs, landscape.TargetFrameMs, numQueued,
+        FMath::Max3(landscape.SampleConcurrency, landscape.MeshConcurrency, landscape.CookConcurrency));
+      concurrency = concurrencyController.getConcurrency();
+      priority = concurrencyController.getPriority();
     }
 
-    // void Exit() override;
+    pipeline->setConcurrency(
+      FMath::Min(landscape.SampleConcurrency, concurrency),
+      FMath::Min(landscape.MeshConcurrency, concurrency),
+      FMath::Min(landscape.CookConcurrency, concurrency));
+    pipeline->setPriority(priority);
 
-    //------------------------------------------------------------------------------
+    SET_DWORD_STAT(STAT_ProceduralLandscape_GenerationQueue, numQueued);
+    SET_DWORD_STAT(STAT_ProceduralLandscape_GenerationConcurrency,
+      FMath::Min(concurrency, FMath::Max3(landscape.SampleConcurrency, landscape.MeshConcurrency, landscape.CookConcurrency)));
+  }
 
-    TArray<std::unique_ptr<GenerationWorkUnit>>
-    getCompletedWork(TArray<std::unique_ptr<GenerationWorkUnit>> emptyArray)
+  //------------------------------------------------------------------------------
+
+  // The static mesh of a generated chunk, if it has one. Triangle collision is cooked by the engine on a worker
+  // and switched on when done, provided the chunk is still loaded as the same actor and still wants collision.
+  // Nanite meshes finish building asynchronously; their memory is measured again once they have.
+  UStaticMesh *
+  buildStaticMesh(AProceduralLandscape *landscape, AChunk *chunkActor, const GenerationWorkUnit &workUnit)
+  {
+    if (workUnit.collisionOnly)
+      return nullptr;
+
+    // work generated for triangle collision before Nanite was switched on still gets a plain mesh to cook it from
+    if (landscape->bNaniteChunks && (!workUnit.withCollision || workUnit.collisionHeightfield))
     {
-      emptyArray.Reset(); // make sure it's empty
-      std::lock_guard lock(doneMutex);
-      return std::exchange(doneWork, std::move(emptyArray));
+      UStaticMesh *staticMesh =
+        buildChunkStaticMesh(chunkActor, workUnit.meshData, false, {}, landscape->NaniteFallbackTrianglePercent);
+      if (staticMesh && staticMesh->IsCompiling())
+        chunksCompiling.Add(workUnit.chunkLocation);
+      return staticMesh;
     }
 
-    TArray<std::unique_ptr<GenerationWorkUnit>> // the same array but now empty
-    submitWorkToDo(TArray<std::unique_ptr<GenerationWorkUnit>> workUnits)
-    {
-      if(!workUnits.IsEmpty())
+    if (!workUnit.withCollision || workUnit.collisionHeightfield)
+      return buildChunkStaticMesh(chunkActor, workUnit.meshData, false);
+
+    const FOnAsyncPhysicsCookFinished onCollisionCooked = FOnAsyncPhysicsCookFinished::CreateWeakLambda(landscape,
+      [this, chunk = workUnit.chunkLocation, weakActor = TWeakObjectPtr<AChunk>{chunkActor}](const bool success)
       {
+        LoadedChunk *loadedChunk = chunksLoaded.Find(chunk);
+        if (!success || !loadedChunk || loadedChunk->actor != weakActor.Get() || !loadedChunk->hasCollision)
+          return;
+
+        loadedChunk->actor->StaticMeshComponent->RecreatePhysicsState();
+        measureChunkMemory(*loadedChunk, loadedChunk->actor->StaticMeshComponent->GetStaticMesh());
+      });
+
+    return buildChunkStaticMesh(chunkActor, workUnit.meshData, true, onCollisionCooked);
+  }
+
+  // measures chunks again whose static meshes have finished building since they were spawned
+  void
+  measureCompiledChunks()
+  {
+    for (auto it = chunksCompiling.CreateIterator(); it; ++it)
+    {
+      LoadedChunk *loadedChunk = chunksLoaded.Find(*it);
+      if (loadedChunk && !loadedChunk->actor)
+        loadedChunk = nullptr; // a volumetric chunk whose surface has since gone
+      UStaticMesh *staticMesh = loadedChunk ? loadedChunk->actor->StaticMeshComponent->GetStaticMesh() : nullptr;
+
+      if (staticMesh && staticMesh->IsCompiling())
+        continue;
+
+      if (loadedChunk)
+        measureChunkMemory(*loadedChunk, staticMesh);
+      it.RemoveCurrent();
+    }
+  }
+
+  //------------------------------------------------------------------------------
+
+  // Chunks that are neither loaded nor loading within the scaled radius of any streaming center, each once,
+  // ordered jointly across centers by distance to a center divided by its weight. Volumetric chunks are in spheres.
+  void
+  enumerateChunksToLoad(const float radius, const float chunkSize, const bool volumetric)
+  {
+    auto enumerate = [&](TArray<FIntVector> &chunks, const FVector center, const float centerRadius)
+    {
+      if (volumetric)
+        enumerateChunksInSphere(chunks, sphereOffsets, center, centerRadius, chunkSize);
+      else
+        enumerateChunksInRadius(chunks, FVector2D{center}, centerRadius, chunkSize);
+    };
+
+    if (streamingCenters.Num() == 1 && streamingCenters[0].rRadiusScale == 1.f)
+    {
+      // already in order
+      enumerate(chunksInRadius_array, streamingCenters[0].location, radius);
+      chunksInRadius_array.RemoveAll([this](const FIntVector chunk) { return chunksLoaded.Contains(chunk) || chunksLoading.Contains(chunk); });
+      return;
+    }
+
+    chunksInRadius_priorities.Reset();
+
+    for (const StreamingCenter &center : streamingCenters)
+    {
+      enumerate(chunksInRadiusOfCenter_array, center.location, radius / center.rRadiusScale);
+
+      for (const FIntVector chunk : chunksInRadiusOfCenter_array)
+        if (!chunksLoaded.Contains(chunk) && !chunksLoading.Contains(chunk))
         {
-          std::lock_guard lock(workMutex);
-          for(auto &workUnit : workUnits)
-            workQueue.push_back(std::move(workUnit));
+          const float priority = (FVector(chunk) * chunkSize - center.location).Size() * center.rWeight;
+          if (float *existing = chunksInRadius_priorities.Find(chunk))
+            *existing = FMath::Min(*existing, priority);
+          else
+            chunksInRadius_priorities.Add(chunk, priority);
         }
-        workConditionVariable.notify_all();
-        workUnits.Reset();
-      }
-      
-      return std::move(workUnits);
     }
-  };
 
-  //==============================================================================
-  
-  struct ProceduralLandscapeProperties
+    chunksInRadius_priorities.ValueSort(TLess<float>{});
+    chunksInRadius_priorities.GenerateKeyArray(chunksInRadius_array);
+  }
+
+  //------------------------------------------------------------------------------
+
+  std::unique_ptr<GenerationWorkUnit>
+  getWorkUnit(
+    const FIntVector chunkLocation,
+    const TerrainParameters &parameters,
+    const ELandscapeCollisionMode collisionMode,
+    const bool collisionOnly,
+    const bool withCollision)
   {
-    UMaterialInterface *LandscapeMaterial{};
-  };
+    std::unique_ptr<GenerationWorkUnit> workUnit = getUnusedWorkUnit();
+    workUnit->chunkLocation = chunkLocation;
+    workUnit->parameters = parameters;
+    workUnit->parametersVersion = parametersVersion;
+    workUnit->collisionMode = collisionOnly ? ELandscapeCollisionMode::Heightfield : collisionMode;
+    workUnit->collisionOnly = collisionOnly;
+    workUnit->withCollision = withCollision;
+    workUnit->scatterRules = scatterRules;
+    workUnit->heightmap = heightmap;
+    workUnit->remesh = false;
+    if (const ChunkEditsPtr *edits = chunkEdits.Find(chunkLocation))
+      workUnit->edits = *edits;
+    return workUnit;
+  }
 
-  //==============================================================================
+  // height offset at an edit grid vertex given relative to any chunk, read from the chunk whose interior holds it
+  float
+  editDeltaAt(FIntVector chunk, int32 x, int32 y) const
+  {
+    const int32 n = editResolution;
+    auto floorDiv = [n](const int32 a) { return a >= 0 ? a / n : -((n - 1 - a) / n); };
 
-  struct UnusedWorkUnits
+    const int32 dx = floorDiv(x), dy = floorDiv(y);
+    chunk.X += dx;
+    chunk.Y += dy;
+
+    if (const ChunkEditsPtr *edits = chunkEdits.Find(chunk))
+      return (*edits)->at(x - dx * n, y - dy * n);
+
+    return 0.f;
+  }
+
+  // Sets the height offset of every edit grid vertex within radius of center, including the outer rings of
+  // neighboring chunks, to newDelta(vertexLocation, chunk, x, y, falloff). All new values are computed before
+  // any are written, so a brush sees the terrain as it was before the brush was applied.
+  template<typename NewDelta>
+  void
+  editTerrain(const FVector2D center, const float radius, const TerrainParameters &parameters, NewDelta &&newDelta)
   {
-    TArray<std::unique_ptr<GenerationWorkUnit>> unusedWorkUnits;
+    if (radius <= 0.f)
+      return;
 
-    std::unique_ptr<GenerationWorkUnit>
-    getUnusedWorkUnit()
+    if (parameters.volumetric)
     {
-      if (unusedWorkUnits.IsEmpty())
-        return std::make_unique<GenerationWorkUnit>();
+      UE_LOG(LogTemp, Warning, TEXT("AProceduralLandscape: height edits apply to heightfield chunks only, not volumetric ones"));
+      return;
+    }
 
-      return unusedWorkUnits.Pop(false);
-    };
+    if (!editResolution)
+      editResolution = parameters.resolution;
 
-    void
-    putUnusedWorkUnit(std::unique_ptr<GenerationWorkUnit> workUnit)
+    const int32 n = editResolution;
+    const float chunkSize = parameters.size;
+    const float step = chunkSize / n;
+    const float radiusSquared = radius * radius;
+
+    struct VertexEdit
     {
-      unusedWorkUnits.Push(std::move(workUnit));
-    }
-  };
-} // namespace
+      FIntVector chunk;
+      int32 x, y;
+      float delta;
+    };
+    TArray<VertexEdit> vertexEdits;
 
-//==============================================================================
+    const int32 xMin = FMath::FloorToInt((center.X - radius - step) / chunkSize + 0.5f);
+    const int32 xMax = FMath::FloorToInt((center.X + radius + step) / chunkSize + 0.5f);
+    const int32 yMin = FMath::FloorToInt((center.Y - radius - step) / chunkSize + 0.5f);
+    const int32 yMax = FMath::FloorToInt((center.Y + radius + step) / chunkSize + 0.5f);
 
-struct AProceduralLandscape::Private : UnusedWorkUnits
-{
-  ProceduralLandscapeProperties properties{};
-  
-  TArray<FIntVector> chunksInRadius_array; // order matters
-  
-  TArray<std::unique_ptr<GenerationWorkUnit>> chunksToGenerate;            // order matters
-  TArray<std::unique_ptr<GenerationWorkUnit>> chunksGenerated;             // order matters
-  TArray<std::unique_ptr<GenerationWorkUnit>> chunksGeneratedAndInRadius;  // order matters
-  
-  TSet<FIntVector> chunksLoading;       // presence matters
-  TMap<FIntVector, AChunk*> chunksLoaded;  // presence matters
-  TArray<AChunk*> chunksToUnload;
+    for (int32 cy = yMin; cy <= yMax; ++cy)
+      for (int32 cx = xMin; cx <= xMax; ++cx)
+      {
+        const FIntVector chunk{cx, cy, 0};
+        const FVector2D minCorner = chunkLocationMinCornerCoordinates(chunk, chunkSize);
+        areEditsLoaded(chunk); // brushes reaching unloaded chunks merge with their saved edits once loaded
+
+        for (int32 y = -1; y <= n + 1; ++y)
+          for (int32 x = -1; x <= n + 1; ++x)
+          {
+            const FVector2D vertex = minCorner + FVector2D{x * step, y * step};
+            const float distanceSquared = (vertex - center).SizeSquared();
+            if (distanceSquared >= radiusSquared)
+              continue;
+
+            const float t = 1.f - distanceSquared / radiusSquared;
+            vertexEdits.Add({chunk, x, y, newDelta(vertex, chunk, x, y, t * t)});
+          }
+      }
+
+    FRWScopeLock lock(queryLock, SLT_Write);
+
+    for (const VertexEdit &vertexEdit : vertexEdits)
+    {
+      ChunkEditsPtr &edits = chunkEdits.FindOrAdd(vertexEdit.chunk);
+      if (!edits)
+        edits = MakeShared<ChunkEdits, ESPMode::ThreadSafe>(n);
+      else if (!edits.IsUnique()) // copy on write: a worker is meshing a snapshot of these edits
+        edits = MakeShared<ChunkEdits, ESPMode::ThreadSafe>(*edits);
+
+      edits->at(vertexEdit.x, vertexEdit.y) = vertexEdit.delta;
+      chunksEdited.Add(vertexEdit.chunk);
+      if (editStorage.IsValid())
+        editsUnsaved.Add(vertexEdit.chunk);
+    }
 
-  std::unique_ptr<MeshGenerator> meshGenerator = std::make_unique<MeshGenerator>();
+    // unloaded chunks answer from the edits directly; loaded ones once re-meshed
+    invalidateHeightPages(center - FVector2D{radius, radius}, center + FVector2D{radius, radius});
+  }
 };
 
 //==============================================================================
@@ -591,16 +2606,50 @@ void AProceduralLandscape::Tick(float DeltaTime)
 {
   Super::Tick(DeltaTime);
 
-  // carefully try to get player location, which might not exist if for example the player was killed
-  FVector2D playerLocation2D{};
-  if( auto maybePlayerLocation = tryGetPlayerLocation(this))
-    playerLocation2D = FVector2D{ *maybePlayerLocation };
-  else
+  // generation runs on the world's shared pool, alongside every other procedural actor in the world
+  if (!p->pipeline)
+  {
+    UProceduralGenerationSubsystem *generation = GetWorld()->GetSubsystem<UProceduralGenerationSubsystem>();
+    if (!generation)
+      return;
+
+    p->pipeline = std::make_unique<GenerationPipeline>(generation->GetPool());
+    p->pipeline->setParametersVersion(p->parametersVersion);
+  }
+
+  // carefully try to get streaming locations, of which there might be none if for example the player was killed
+  p->streamingCenters.Reset();
+  if( bStreamAroundPlayers )
+    addPlayerStreamingCenters(this, p->streamingCenters);
+  addStreamingSourceCenters(StreamingSources, p->streamingCenters);
+  if( p->streamingCenters.IsEmpty() )
     if( auto maybeEditorViewLocation = tryGetEditorViewLocation(this))
-      playerLocation2D = FVector2D{ *maybeEditorViewLocation };
+      p->streamingCenters.Add({*maybeEditorViewLocation, 1.f, 1.f});
     else
       return; // couldn't get any location
+  if( !bVolumetric )
+    for( StreamingCenter &center : p->streamingCenters )
+      center.location.Z = 0.f; // heightfield chunks are columns, all at Z = 0
+  const TArrayView<const StreamingCenter> streamingCenters = p->streamingCenters;
   
+  const TerrainParameters terrainParameters = p->currentTerrainParameters(*this);
+  // volumetric chunks have no heightfield, so they always have a mesh and collide with its triangles
+  const bool collisionOnly = !bVolumetric && (bCollisionOnly || (bCollisionOnlyOnDedicatedServer && GetNetMode() == NM_DedicatedServer));
+  // Nanite meshes collide through their reduced fallback mesh, so their collision comes from the full heights instead
+  const ELandscapeCollisionMode collisionMode =
+    bVolumetric ? ELandscapeCollisionMode::TriangleMesh : bNaniteChunks ? ELandscapeCollisionMode::Heightfield : CollisionMode;
+  updateScatterRules(p->scatterRules, ScatterLayers, collisionOnly);
+
+  // chunks get collision within CollisionRadius and keep it until a chunk further out, so that
+  // walking back and forth along the boundary doesn't build and release the same chunk's collision every frame
+  const float collisionRadius = CollisionRadius > 0.f ? CollisionRadius : TNumericLimits<float>::Max();
+  const float collisionReleaseRadius = CollisionRadius > 0.f ? CollisionRadius + ChunkSize : TNumericLimits<float>::Max();
+  auto isInCollisionRadius = [&](const FIntVector chunk)
+  {
+    return collisionRadius == TNumericLimits<float>::Max()
+      || distanceSquaredToNearest(chunk, streamingCenters, ChunkSize) <= collisionRadius * collisionRadius;
+  };
+
   //- - - - - - - - - - - - - - - - - - - -
 
   // check for and propagate change of LandscapeMaterial to all chunks
@@ -613,47 +2662,67 @@ void AProceduralLandscape::Tick(float DeltaTime)
 
       // propagate new landscape material to all chunks
       for( const auto &loadedChunk : p->chunksLoaded )
-        loadedChunk.Value->StaticMeshComponent->SetMaterial(0, LandscapeMaterial);
+        if( loadedChunk.Value.actor )
+          loadedChunk.Value.actor->StaticMeshComponent->SetMaterial(0, LandscapeMaterial);
     }
   
   //- - - - - - - - - - - - - - - - - - - - 
 
+  // stamp work from here on with a new version if the terrain parameters changed
+  p->updateParametersVersion(terrainParameters);
+  p->updateConcurrency(*this);
+
+  //- - - - - - - - - - - - - - - - - - - - 
+
   // check if old chunks need to be unloaded
-  destroyChunksOutsideRadius(p->chunksLoaded, playerLocation2D, UnloadRadius, ChunkSize);
+  destroyChunksOutsideRadius(p->chunksLoaded, p->chunksUnloaded, streamingCenters, UnloadRadius, ChunkSize);
+  p->forgetUnloadedHeightfields();
+  p->setQueryParameters(terrainParameters);
   
   //- - - - - - - - - - - - - - - - - - - - 
   
-  // get list of chunks which might need to be loaded
-  enumerateChunksInRadius(p->chunksInRadius_array, playerLocation2D, LoadRadius, ChunkSize);
+  // get list of chunks which need to be loaded, nearest first
+  p->enumerateChunksToLoad(FMath::Min(LoadRadius, p->budgetRadius), ChunkSize, bVolumetric);
 
-  // refine list to chunks which do need to be loaded
+  // with bPersistEdits, heightfield chunks wait for their saved edits before they are generated
   for( auto chunkInRadius : p->chunksInRadius_array )
-    if( !p->chunksLoaded.Contains(chunkInRadius) && !p->chunksLoading.Contains(chunkInRadius) )
-    {
-      std::unique_ptr<GenerationWorkUnit> workUnit = p->getUnusedWorkUnit();
-      workUnit->chunkLocation = chunkInRadius;
-      workUnit->resolution = StepsPerChunk;
-      workUnit->size = ChunkSize;
-      workUnit->horizontalNoiseScale = HorizontalNoiseScale;
-      workUnit->verticalScale = VerticalScale;
-      p->chunksToGenerate.Emplace(std::move(workUnit));
-    }
+    if( terrainParameters.volumetric || p->areEditsLoaded(chunkInRadius) )
+      p->chunksToGenerate.Emplace(
+        p->getWorkUnit(chunkInRadius, terrainParameters, collisionMode, collisionOnly, isInCollisionRadius(chunkInRadius)));
   
   //- - - - - - - - - - - - - - - - - - - - 
 
   // get fresh chunks
-  p->chunksGenerated = p->meshGenerator->getCompletedWork(std::move(p->chunksGenerated));
+  p->chunksGenerated = p->pipeline->getCompletedWork(std::move(p->chunksGenerated));
   
-  // update set of chunksLoading AND discard fresh chunks that are now outside of UnloadRadius
+  // discard fresh chunks that are now outside of UnloadRadius or the memory budget, or that were generated for
+  // parameters that have since changed; those are requested again below. The rest stay loading until spawned.
+  const float keepRadius = FMath::Min(UnloadRadius, p->budgetRadius);
   for( auto &workUnit : p->chunksGenerated )
   {
-    p->chunksLoading.Remove(workUnit->chunkLocation);
-    
-    if(const auto [x,y,z] = workUnit->chunkLocation;
-      (FVector2D{x*ChunkSize,y*ChunkSize}-playerLocation2D).SizeSquared() <= UnloadRadius*UnloadRadius)
+    const bool stale = workUnit->parametersVersion != p->parametersVersion;
+
+    if( workUnit->remesh )
+    {
+      // still remeshing while waiting to be swapped in, so that the chunk isn't submitted again meanwhile
+      if( p->chunksLoaded.Contains(workUnit->chunkLocation) && !stale )
+        p->chunksRemeshed.Push(std::move(workUnit));
+      else
+      {
+        p->chunksRemeshing.Remove(workUnit->chunkLocation);
+        p->putUnusedWorkUnit(std::move(workUnit));
+      }
+
+      continue;
+    }
+
+    if( !stale && distanceSquaredToNearest(workUnit->chunkLocation, streamingCenters, ChunkSize) <= keepRadius*keepRadius )
         p->chunksGeneratedAndInRadius.Push(std::move(workUnit));
     else
+    {
+      p->chunksLoading.Remove(workUnit->chunkLocation);
       p->putUnusedWorkUnit(std::move(workUnit));
+    }
   }
   p->chunksGenerated.Reset();
   
@@ -662,57 +2731,339 @@ void AProceduralLandscape::Tick(float DeltaTime)
   // start generating meshes (loading) chunks asynchronously
   for( const auto &workUnit : p->chunksToGenerate )
     p->chunksLoading.Add(workUnit->chunkLocation);
-  p->chunksToGenerate = p->meshGenerator->submitWorkToDo(std::move(p->chunksToGenerate));
+  p->chunksToGenerate = p->pipeline->submitWorkToDo(std::move(p->chunksToGenerate));
   
   //- - - - - - - - - - - - - - - - - - - - 
 
-  // create actors from just-created chunks collected at the top of this function
-  for( auto &workUnit : p->chunksGeneratedAndInRadius )
+  // re-mesh loaded chunks whose height edits changed; at most one re-mesh per chunk is in flight,
+  // and chunks that are still being generated are picked up once they have loaded
+  for( auto it = p->chunksEdited.CreateIterator(); it; ++it )
+    if( !p->chunksLoading.Contains(*it) && !p->chunksRemeshing.Contains(*it) )
+    {
+      if( const LoadedChunk *loadedChunk = p->chunksLoaded.Find(*it) )
+      {
+        std::unique_ptr<GenerationWorkUnit> workUnit =
+          p->getWorkUnit(*it, terrainParameters, collisionMode, collisionOnly, loadedChunk->hasCollision || isInCollisionRadius(*it));
+        workUnit->remesh = true;
+        p->chunksRemeshing.Add(*it);
+        p->chunksToRemesh.Push(std::move(workUnit));
+      }
+      it.RemoveCurrent();
+    }
+
+  // build collision for loaded chunks coming within CollisionRadius and release it from those leaving; heightfields
+  // only need the chunk's heights, cooked triangle collision needs the chunk's static mesh rebuilt
+  if( CollisionRadius > 0.f )
+    for( auto &entry : p->chunksLoaded )
+    {
+      const FIntVector chunk = entry.Key;
+      LoadedChunk &loadedChunk = entry.Value;
+
+      if( !loadedChunk.actor )
+        continue; // nothing to collide with
+
+      if( !loadedChunk.hasCollision )
+      {
+        // stale chunks get collision with their regeneration instead
+        if( !p->chunksRemeshing.Contains(chunk) && loadedChunk.parametersVersion == p->parametersVersion && isInCollisionRadius(chunk) )
+        {
+          std::unique_ptr<GenerationWorkUnit> workUnit = p->getWorkUnit(chunk, terrainParameters, collisionMode, collisionOnly, true);
+          workUnit->remesh = true;
+          if( workUnit->collisionMode == ELandscapeCollisionMode::Heightfield )
+          {
+            workUnit->collisionOnly = true;
+            workUnit->collisionUpdate = true;
+            workUnit->scatterRules.Reset();
+          }
+          p->chunksRemeshing.Add(chunk);
+          p->chunksToRemesh.Push(std::move(workUnit));
+        }
+      }
+      else if( distanceSquaredToNearest(chunk, streamingCenters, ChunkSize) > collisionReleaseRadius * collisionReleaseRadius )
+      {
+        loadedChunk.actor->ClearCollision();
+        loadedChunk.hasCollision = false;
+        measureChunkMemory(loadedChunk, loadedChunk.actor->StaticMeshComponent->GetStaticMesh());
+      }
+    }
+
+  // regenerate chunks made with old terrain parameters, a few ticks' worth of swaps at a time
+  p->regenerateStaleChunks(streamingCenters, ChunkSize, 4 * FMath::Max(1, MaxChunkRebuildsPerTick), [&](const FIntVector chunk, const LoadedChunk &loadedChunk)
   {
-    AChunk* chunkActor = GetWorld()->SpawnActorDeferred<AChunk>(AChunk::StaticClass(), FTransform());
+    return p->getWorkUnit(chunk, terrainParameters, collisionMode, collisionOnly, loadedChunk.hasCollision || isInCollisionRadius(chunk));
+  });
 
-    UProceduralMeshComponent *proceduralMesh = NewObject<UProceduralMeshComponent>(this);
-    
-    // proceduralMesh->bUseComplexAsSimpleCollision = true;
-    // proceduralMesh->SetMobility(EComponentMobility::Static);
-    // proceduralMesh->SetCollisionEnabled(ECollisionEnabled::QueryAndPhysics);
-    // proceduralMesh->SetCollisionObjectType(ECollisionChannel::ECC_WorldStatic);
-    
-    createProceduralMeshSection(proceduralMesh, 0, workUnit->meshData);
+  p->chunksToRemesh = p->pipeline->submitWorkToDo(std::move(p->chunksToRemesh), true);
 
-    UStaticMesh *staticMesh = convertProceduralMeshToStaticMesh(chunkActor->StaticMeshComponent, proceduralMesh);
+  //- - - - - - - - - - - - - - - - - - - - 
 
-    // these settings alone don't seem to enable pawn <-> complex collision
-    //staticMesh->ComplexCollisionMesh = staticMesh;
-    
+  // gives a loaded chunk an actor with the static mesh, collision and scatter of workUnit
+  auto spawnChunkActor = [&](LoadedChunk &loadedChunk, GenerationWorkUnit &workUnit)
+  {
+    AChunk* chunkActor = GetWorld()->SpawnActorDeferred<AChunk>(AChunk::StaticClass(), FTransform());
+
+    UStaticMesh *staticMesh = p->buildStaticMesh(this, chunkActor, workUnit);
     chunkActor->StaticMeshComponent->SetStaticMesh(staticMesh);
-    proceduralMesh->DestroyComponent();
 
     // chunkActor->mesh->bAlwaysCreatePhysicsState = true;
     // chunkActor->mesh->bUseDefaultCollision = true;
     
     chunkActor->Material = LandscapeMaterial;
     chunkActor->RuntimeVirtualTextures = RuntimeVirtualTextures;
+    chunkActor->RuntimeVirtualTextures.Remove(p->heightVirtualTexture);
     chunkActor->VirtualTextureLodBias = VirtualTextureLodBias;
     chunkActor->VirtualTextureCullMips = VirtualTextureCullMips;
     chunkActor->VirtualTextureMinCoverage = VirtualTextureMinCoverage;
     chunkActor->VirtualTextureRenderPassType = VirtualTextureRenderPassType;
     chunkActor->SetFolderPath("/Chunks");
 
+    // heightfield chunk meshes are at their heights above Z = 0, volumetric ones within their cube
     const FVector chunkTranslation{
-      (workUnit->chunkLocation.X - 0.5f) * ChunkSize,
-      (workUnit->chunkLocation.Y - 0.5f) * ChunkSize,
-      0.f};
+      (workUnit.chunkLocation.X - 0.5f) * ChunkSize,
+      (workUnit.chunkLocation.Y - 0.5f) * ChunkSize,
+      workUnit.parameters.volumetric ? (workUnit.chunkLocation.Z - 0.5f) * ChunkSize : 0.f};
     UGameplayStatics::FinishSpawningActor(chunkActor, FTransform{chunkTranslation});
 
+    loadedChunk.actor = chunkActor;
+    applyChunkCollision(loadedChunk, workUnit);
+
+    addScatter(chunkActor, ScatterLayers, workUnit.scatterTransforms);
+
+    measureChunkMemory(loadedChunk, staticMesh);
+  };
+
+  // volumetric chunks of only air or rock have no surface to mesh and are loaded without an actor
+  auto hasSurface = [](const GenerationWorkUnit &workUnit)
+  {
+    return !workUnit.parameters.volumetric || !workUnit.meshData.triangles.IsEmpty();
+  };
+
+  // create actors from generated chunks in the order they finished, at most MaxChunkSpawnsPerTick per frame since building
+  // static meshes is game thread work; the rest wait for the next frames, rechecked against the radius and version
+  const int32 numSpawns = FMath::Min(p->chunksGeneratedAndInRadius.Num(), MaxChunkSpawnsPerTick);
+  for( int32 i = 0; i < numSpawns; ++i )
+  {
+    std::unique_ptr<GenerationWorkUnit> workUnit = std::move(p->chunksGeneratedAndInRadius[i]);
+    p->chunksLoading.Remove(workUnit->chunkLocation);
+
+    if( workUnit->parametersVersion != p->parametersVersion
+      || distanceSquaredToNearest(workUnit->chunkLocation, streamingCenters, ChunkSize) > keepRadius*keepRadius )
+    {
+      p->putUnusedWorkUnit(std::move(workUnit));
+      continue;
+    }
+
+    LoadedChunk loadedChunk{nullptr, workUnit->parametersVersion};
+    if( hasSurface(*workUnit) )
+      spawnChunkActor(loadedChunk, *workUnit);
+
     if(p->chunksLoaded.Contains(workUnit->chunkLocation))
       UE_LOG(LogTemp, Warning, TEXT("ERROR: trying to add loaded chunk that is already loaded"));
       
-    p->chunksLoaded.Add(workUnit->chunkLocation, chunkActor);
+    if( workUnit->heightfield )
+      p->setHeightfield(loadedChunk, workUnit->heightfield);
+    p->chunksLoaded.Add(workUnit->chunkLocation, loadedChunk);
     
     p->putUnusedWorkUnit(std::move(workUnit));
   }
-  p->chunksGeneratedAndInRadius.Reset();
+  p->chunksGeneratedAndInRadius.RemoveAt(0, numSpawns, false);
+
+  //- - - - - - - - - - - - - - - - - - - - 
+
+  // swap re-meshed chunks in place: the old mesh stays until the new one replaces it in the same frame, so nothing flickers
+  const int32 numSwaps = FMath::Min(p->chunksRemeshed.Num(), MaxChunkRebuildsPerTick);
+  for( int32 i = 0; i < numSwaps; ++i )
+  {
+    std::unique_ptr<GenerationWorkUnit> workUnit = std::move(p->chunksRemeshed[i]);
+    p->chunksRemeshing.Remove(workUnit->chunkLocation);
+
+    LoadedChunk *loadedChunk = p->chunksLoaded.Find(workUnit->chunkLocation);
+    if( workUnit->parametersVersion != p->parametersVersion )
+      loadedChunk = nullptr; // parameters changed while this waited to be swapped in; the chunk is queued for regeneration again
+
+    if( loadedChunk )
+    {
+      if( workUnit->collisionUpdate )
+      {
+        applyChunkCollision(*loadedChunk, *workUnit);
+        measureChunkMemory(*loadedChunk, loadedChunk->actor->StaticMeshComponent->GetStaticMesh());
+      }
+      else if( !loadedChunk->actor || !hasSurface(*workUnit) )
+      {
+        // volumetric chunks gain or lose their actor as their surface comes and goes
+        if( loadedChunk->actor )
+          loadedChunk->actor->Destroy();
+        *loadedChunk = LoadedChunk{nullptr, workUnit->parametersVersion};
+        if( hasSurface(*workUnit) )
+          spawnChunkActor(*loadedChunk, *workUnit);
+      }
+      else
+      {
+        UStaticMesh *staticMesh = p->buildStaticMesh(this, loadedChunk->actor, *workUnit);
+        loadedChunk->actor->StaticMeshComponent->SetStaticMesh(staticMesh);
+        loadedChunk->parametersVersion = workUnit->parametersVersion;
+        applyChunkCollision(*loadedChunk, *workUnit);
+        loadedChunk->actor->ClearScatter();
+        addScatter(loadedChunk->actor, ScatterLayers, workUnit->scatterTransforms);
+        measureChunkMemory(*loadedChunk, staticMesh);
+      }
+      if( workUnit->heightfield )
+        p->setHeightfield(*loadedChunk, workUnit->heightfield);
+
+      const FVector2D minCorner = chunkLocationMinCornerCoordinates(workUnit->chunkLocation, ChunkSize);
+      p->invalidateHeightPages(minCorner, minCorner + FVector2D{ChunkSize, ChunkSize});
+    }
+
+    p->putUnusedWorkUnit(std::move(workUnit));
+  }
+  p->chunksRemeshed.RemoveAt(0, numSwaps, false);
+
+  //- - - - - - - - - - - - - - - - - - - - 
+
+  // keep chunk meshes, collision and pooled work units within MemoryBudgetMB
+  p->measureCompiledChunks();
+  p->enforceMemoryBudget(SIZE_T(double(MemoryBudgetMB) * 1024 * 1024), streamingCenters, ChunkSize);
+}
+
+void AProceduralLandscape::AddStreamingSource(AActor *Source, const float RadiusScale, const float Weight)
+{
+  if (!Source)
+    return;
+
+  FLandscapeStreamingSource *source = StreamingSources.FindByPredicate(
+    [Source](const FLandscapeStreamingSource &existing) { return existing.Actor == Source; });
+  if (!source)
+    source = &StreamingSources.AddDefaulted_GetRef();
+
+  source->Actor = Source;
+  source->RadiusScale = RadiusScale;
+  source->Weight = Weight;
+}
+
+void AProceduralLandscape::RemoveStreamingSource(AActor *Source)
+{
+  StreamingSources.RemoveAll([Source](const FLandscapeStreamingSource &existing) { return existing.Actor == Source; });
+}
+
+int64 AProceduralLandscape::GetEstimatedMemoryUsage() const
+{
+  return int64(p->estimatedMemoryUsage);
+}
+
+//==============================================================================
+// Terrain editing
+
+void AProceduralLandscape::AddHeight(const FVector Location, const float Radius, const float Amount)
+{
+  p->editTerrain(FVector2D{Location}, Radius, p->currentTerrainParameters(*this),
+    [this, Amount](FVector2D, const FIntVector chunk, const int32 x, const int32 y, const float falloff)
+    {
+      return p->editDeltaAt(chunk, x, y) + Amount * falloff;
+    });
+}
+
+bool AProceduralLandscape::ImportHeightmap(const FString &SourceFile)
+{
+  const FString tiledFile = FPaths::ChangeExtension(SourceFile, TEXT("theightmap"));
+  if (!p->heightmapImportTarget.IsEmpty())
+  {
+    UE_LOG(LogTemp, Warning, TEXT("AProceduralLandscape: the last imported heightmap isn't in place yet, import %s again later"), *SourceFile);
+    return false;
+  }
+
+  if (!FTiledHeightmap::Import(SourceFile, tiledFile))
+    return false;
+
+  HeightmapFile.FilePath = tiledFile;
+  p->swapInImportedHeightmap(tiledFile);
+  return true;
+}
+
+void AProceduralLandscape::Flatten(const FVector Location, const float Radius, float Strength)
+{
+  Strength = FMath::Clamp(Strength, 0.f, 1.f);
+  const TerrainParameters parameters = p->currentTerrainParameters(*this);
+
+  p->editTerrain(FVector2D{Location}, Radius, parameters,
+    [this, &parameters, targetHeight = float(Location.Z), Strength]
+    (const FVector2D vertex, const FIntVector chunk, const int32 x, const int32 y, const float falloff)
+    {
+      const float delta = p->editDeltaAt(chunk, x, y);
+      const float height = sampleBaseHeight(parameters, p->heightmap.Get(), vertex) + delta;
+      return delta + (targetHeight - height) * Strength * falloff;
+    });
+}
+
+void AProceduralLandscape::Smooth(const FVector Location, const float Radius, float Strength)
+{
+  Strength = FMath::Clamp(Strength, 0.f, 1.f);
+  const TerrainParameters parameters = p->currentTerrainParameters(*this);
+
+  p->editTerrain(FVector2D{Location}, Radius, parameters,
+    [this, &parameters, Strength]
+    (const FVector2D vertex, const FIntVector chunk, const int32 x, const int32 y, const float falloff)
+    {
+      const float step = parameters.size / p->editResolution;
+      auto heightAt = [&](const int32 dx, const int32 dy)
+      {
+        return sampleBaseHeight(parameters, p->heightmap.Get(), vertex + FVector2D{dx * step, dy * step}) + p->editDeltaAt(chunk, x + dx, y + dy);
+      };
+
+      const float delta = p->editDeltaAt(chunk, x, y);
+      const float height = heightAt(0, 0);
+      const float average = 0.25f * (heightAt(-1, 0) + heightAt(1, 0) + heightAt(0, -1) + heightAt(0, 1));
+      return delta + (average - height) * Strength * falloff;
+    });
+}
+
+void AProceduralLandscape::ClearEdits()
+{
+  for (const auto &edits : p->chunkEdits)
+    p->chunksEdited.Add(edits.Key);
+
+  {
+    FRWScopeLock lock(p->queryLock, SLT_Write);
+    p->chunkEdits.Empty();
+    p->editResolution = 0;
+  }
+  p->clearSavedEdits();
+
+  p->invalidateHeightPages(FVector2D{HeightVirtualTextureBounds.Min}, FVector2D{HeightVirtualTextureBounds.Max});
+}
+
+//==============================================================================
+// Terrain queries
+
+float AProceduralLandscape::GetHeightAt(const FVector Location) const
+{
+  FRWScopeLock lock(p->queryLock, SLT_ReadOnly);
+  return p->queryHeight_AssumesLocked(FVector2D{Location}, nullptr);
+}
+
+FVector AProceduralLandscape::GetNormalAt(const FVector Location) const
+{
+  FVector normal;
+  FRWScopeLock lock(p->queryLock, SLT_ReadOnly);
+  p->queryHeight_AssumesLocked(FVector2D{Location}, &normal);
+  return normal;
+}
+
+void AProceduralLandscape::GetHeightsAt(const TArray<FVector> &Locations, TArray<float> &OutHeights) const
+{
+  OutHeights.SetNumUninitialized(Locations.Num());
+
+  FRWScopeLock lock(p->queryLock, SLT_ReadOnly);
+  for (int32 i = 0; i < Locations.Num(); ++i)
+    OutHeights[i] = p->queryHeight_AssumesLocked(FVector2D{Locations[i]}, nullptr);
+}
+
+void AProceduralLandscape::GetNormalsAt(const TArray<FVector> &Locations, TArray<FVector> &OutNormals) const
+{
+  OutNormals.SetNumUninitialized(Locations.Num());
+
+  FRWScopeLock lock(p->queryLock, SLT_ReadOnly);
+  for (int32 i = 0; i < Locations.Num(); ++i)
+    p->queryHeight_AssumesLocked(FVector2D{Locations[i]}, &OutNormals[i]);
 }
 
 // Called when the game starts or when spawned
@@ -720,4 +3071,27 @@ void AProceduralLandscape::BeginPlay()
 {
 	Super::BeginPlay();
 	
+  p->setQueryParameters(p->currentTerrainParameters(*this));
+
+  if (HeightVirtualTexture)
+    p->startHeightVirtualTexture(HeightVirtualTexture, HeightVirtualTextureBounds);
+
+  if (bPersistEdits)
+    if (UChunkStorage *storage = GetWorld()->GetSubsystem<UChunkStorage>())
+    {
+      p->editStorage = storage;
+      p->editOwner = this;
+      p->editChannel = FName{TEXT("TerrainEdits_") + GetName()};
+    }
+}
+
+void AProceduralLandscape::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+  p->stopHeightVirtualTexture();
+  p->saveAllEdits();
+
+  // waits for this landscape's jobs; they run on the world's pool, which goes away with the world
+  p->pipeline.reset();
+
+  Super::EndPlay(EndPlayReason);
 }
@@ -5,24 +5,153 @@
 #include "CoreMinimal.h"
 #include "ProceduralLandscape.generated.h"
 
+UENUM()
+enum class ELandscapeCollisionMode : uint8
+{
+  /** Each chunk's static mesh cooks its triangles as complex-as-simple collision. */
+  TriangleMesh,
+  /** Each chunk gets a Chaos heightfield built from its sampled heights by a generation task; nothing is cooked. */
+  Heightfield,
+};
+
+UENUM()
+enum class ELandscapeHeightSource : uint8
+{
+  Perlin,
+  Simplex,
+  /** Perlin noise in octaves: coarse hills with finer detail over them. */
+  PerlinFbm,
+  SimplexFbm,
+  /** Octaves of sharp-crested Perlin noise, for mountain ranges. */
+  RidgedFbm,
+  /** Perlin octaves for the ground with ridged octaves over them, weighted by RidgeWeight. */
+  HillsAndRidges,
+  /** The tiled heightmap in HeightmapFile, one texel per HorizontalNoiseScale, its full range over VerticalScale. */
+  Heightmap,
+};
+
+/** One kind of prop scattered over every chunk, placed by the generation tasks and rendered as instances. */
+USTRUCT(BlueprintType)
+struct FLandscapeScatterLayer
+{
+  GENERATED_BODY()
+
+  UPROPERTY(EditAnywhere, BlueprintReadWrite)
+  UStaticMesh *Mesh = nullptr;
+
+  /** Candidate placements per chunk; the rules below reject some of them. Placements are the same every time a chunk loads. */
+  UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0", ClampMax="100000"))
+  int32 InstancesPerChunk = 100;
+
+  /** Allowed ground slope, in degrees from horizontal. */
+  UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0.0", ClampMax="90.0"))
+  float MinSlope = 0.f;
+
+  UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0.0", ClampMax="90.0"))
+  float MaxSlope = 30.f;
+
+  /** Allowed ground height, in world units. */
+  UPROPERTY(EditAnywhere, BlueprintReadWrite)
+  float MinHeight = -100000.f;
+
+  UPROPERTY(EditAnywhere, BlueprintReadWrite)
+  float MaxHeight = 100000.f;
+
+  /** Uniform scale is picked at random between these. */
+  UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0.01"))
+  float MinScale = 1.f;
+
+  UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0.01"))
+  float MaxScale = 1.f;
+
+  /** Tilt instances to the ground normal instead of keeping them upright. */
+  UPROPERTY(EditAnywhere, BlueprintReadWrite)
+  bool bAlignToNormal = false;
+
+  UPROPERTY(EditAnywhere, BlueprintReadWrite)
+  bool bRandomYaw = true;
+
+  UPROPERTY(EditAnywhere, BlueprintReadWrite)
+  bool bCollision = false;
+
+  /** Instances further than this from the camera are not drawn; zero draws them at any distance. */
+  UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0"))
+  int32 CullDistance = 0;
+};
+
+/** Something other than a player's pawn that terrain should be loaded around, such as a camera. */
+USTRUCT(BlueprintType)
+struct FLandscapeStreamingSource
+{
+  GENERATED_BODY()
+
+  UPROPERTY(EditAnywhere, BlueprintReadWrite)
+  TObjectPtr<AActor> Actor = nullptr;
+
+  /** Multiplies LoadRadius, UnloadRadius and CollisionRadius around this source. */
+  UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0.01", ClampMax="100.0"))
+  float RadiusScale = 1.f;
+
+  /** Loading priority relative to other sources: chunks load in order of distance divided by weight. */
+  UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0.01", ClampMax="100.0"))
+  float Weight = 1.f;
+};
+
 UCLASS()
 class THIRDPERSON_API AProceduralLandscape : public AActor
 {
   GENERATED_BODY()
 
 public:
-  /** Chunks with centers within this radius of the first local player will be loaded automatically. */
+  /** Chunks with centers within this radius of any streaming source will be loaded automatically. */
   UPROPERTY(EditAnywhere, meta=(ClampMin="1000.0", ClampMax="10000000.0"))
   float LoadRadius = 1000.f;
   
-  /** Chunks with centers outside this radius of the first local player will be unloaded automatically. */
+  /** Chunks with centers outside this radius of every streaming source will be unloaded automatically. */
   UPROPERTY(EditAnywhere, meta=(ClampMin="1000.0", ClampMax="10000000.0"))
   float UnloadRadius = 1333.f;
 
+  /**
+   * Only chunks with centers within this radius of a streaming source get collision; chunks further out are render-only and
+   * their collision is built as a player approaches and released once they are a chunk beyond it again.
+   * Zero gives every loaded chunk collision.
+   */
+  UPROPERTY(EditAnywhere, meta=(ClampMin="0.0", ClampMax="10000000.0"))
+  float CollisionRadius = 0.f;
+
+  /**
+   * Stream around every local player, or every player on a server: their pawns, or their cameras while they
+   * have no pawn, for example while spectating. Each counts as a source of weight and radius scale 1.
+   */
+  UPROPERTY(EditAnywhere)
+  bool bStreamAroundPlayers = true;
+
+  /**
+   * Further sources to stream around, in addition to players. Chunks wanted by several sources are loaded once,
+   * in a single queue ordered across all sources. Without any source the editor view is used.
+   */
+  UPROPERTY(EditAnywhere, BlueprintReadWrite)
+  TArray<FLandscapeStreamingSource> StreamingSources;
+
+  /** Adds Source to StreamingSources, or updates its radius scale and weight if it is already there. */
+  UFUNCTION(BlueprintCallable)
+  void AddStreamingSource(AActor *Source, float RadiusScale = 1.f, float Weight = 1.f);
+
+  UFUNCTION(BlueprintCallable)
+  void RemoveStreamingSource(AActor *Source);
+
   /** Chunk grid resolution. */
   UPROPERTY(EditAnywhere, meta=(ClampMin="1", ClampMax="255"))
   int32 StepsPerChunk = 1;
 
+  /**
+   * Largest height error, in world units, allowed when simplifying chunk meshes on gentle terrain; zero keeps the
+   * full grid. Only applies when StepsPerChunk is a power of two. Chunk borders always keep every vertex, so chunks
+   * meet without cracks, and heightfield collision and height queries always use the full grid.
+   */
+  UPROPERTY(EditAnywhere, meta=(ClampMin="0.0"))
+  float MeshErrorTolerance = 0.f;
+
   /** Chunk size along one side. */
   UPROPERTY(EditAnywhere, meta=(ClampMin="1.0", ClampMax="100000.0"))
   float ChunkSize = 1000.f;
@@ -31,14 +160,199 @@ public:
   UPROPERTY(EditAnywhere, meta=(ClampMin="100.0", ClampMax="1000000.0"))
   float HorizontalNoiseScale = 1000.f;
 
+  /** The function the landscape's height comes from, before VerticalScale and edits. */
+  UPROPERTY(EditAnywhere)
+  ELandscapeHeightSource HeightSource = ELandscapeHeightSource::Perlin;
+
+  /** Octaves of the fractal height sources. */
+  UPROPERTY(EditAnywhere, meta=(ClampMin="1", ClampMax="12"))
+  int32 Octaves = 4;
+
+  /** Frequency multiplier from one octave to the next. */
+  UPROPERTY(EditAnywhere, meta=(ClampMin="1.0", ClampMax="4.0"))
+  float Lacunarity = 2.f;
+
+  /** Amplitude multiplier from one octave to the next. */
+  UPROPERTY(EditAnywhere, meta=(ClampMin="0.0", ClampMax="1.0"))
+  float Gain = 0.5f;
+
+  /** Weight of the ridges over the hills in HillsAndRidges. */
+  UPROPERTY(EditAnywhere, meta=(ClampMin="0.0", ClampMax="4.0"))
+  float RidgeWeight = 0.5f;
+
+  /**
+   * Tiled heightmap read by the Heightmap height source; see ImportHeightmap. The file is memory-mapped and only
+   * the tiles under chunks being generated are read, so its size is not limited by memory.
+   */
+  UPROPERTY(EditAnywhere, meta=(FilePathFilter="Tiled heightmap (*.theightmap)|*.theightmap"))
+  FFilePath HeightmapFile;
+
+  /** Catmull-Rom bicubic filtering of the heightmap, for smooth slopes when StepsPerChunk exceeds its resolution; else bilinear. */
+  UPROPERTY(EditAnywhere)
+  bool bBicubicHeightmap = true;
+
+  /**
+   * Converts a 16-bit grayscale PNG or a square 16-bit RAW heightmap into a tiled heightmap next to it,
+   * with the .theightmap extension, and makes it the HeightmapFile. A file already there is replaced once chunks
+   * being generated from it are done. Returns false if the conversion failed, or the last import isn't in place yet.
+   */
+  UFUNCTION(BlueprintCallable)
+  bool ImportHeightmap(const FString &SourceFile);
+
   /** Landscape Z-values will vary between 0.0 and this scale value. */
   UPROPERTY(EditAnywhere, meta=(ClampMin="1.0", ClampMax="10000.0"))
   float VerticalScale = 10.f;
 
+  /**
+   * Stream cubic chunks, ChunkSize on every side, in spheres around streaming sources instead of columns, and mesh
+   * the surface of a volume: rock below the height source's terrain, carved by 3D noise into overhangs and caves.
+   * Chunks of only air or rock get no actor and cost next to nothing. Volumetric chunks always collide with their
+   * mesh triangles and have no scatter or height edits; terrain queries answer the height source's terrain.
+   */
+  UPROPERTY(EditAnywhere)
+  bool bVolumetric = false;
+
+  /** Size in world units of the 3D noise features that carve volumetric terrain. */
+  UPROPERTY(EditAnywhere, meta=(ClampMin="100.0", ClampMax="1000000.0", EditCondition="bVolumetric"))
+  float CaveScale = 1000.f;
+
+  /** How far, in world units, the 3D noise moves volumetric terrain's surface; zero leaves it the height source's. */
+  UPROPERTY(EditAnywhere, meta=(ClampMin="0.0", ClampMax="100000.0", EditCondition="bVolumetric"))
+  float CaveDepth = 500.f;
+
+  /** How chunks collide. Heightfields skip collision cooking entirely and take much less physics memory. */
+  UPROPERTY(EditAnywhere)
+  ELandscapeCollisionMode CollisionMode = ELandscapeCollisionMode::TriangleMesh;
+
+  /**
+   * Build chunk static meshes with Nanite data, so that high StepsPerChunk costs little to render. The engine builds
+   * the Nanite data asynchronously. Nanite chunks always use heightfield collision, built from the full sampled
+   * heights rather than from the reduced fallback mesh. Applies to chunks generated from now on.
+   */
+  UPROPERTY(EditAnywhere)
+  bool bNaniteChunks = false;
+
+  /** Share of each Nanite chunk's triangles kept in its fallback mesh, for where Nanite isn't supported. */
+  UPROPERTY(EditAnywhere, meta=(ClampMin="0.0", ClampMax="100.0", EditCondition="bNaniteChunks"))
+  float NaniteFallbackTrianglePercent = 10.f;
+
+  /**
+   * Generate only what collision and height queries need: no render mesh, UVs, normals or tangents, and always
+   * heightfield collision. Scatter layers without collision are skipped. For servers and other headless instances.
+   */
+  UPROPERTY(EditAnywhere)
+  bool bCollisionOnly = false;
+
+  /** Use collision-only generation automatically when running as a dedicated server. */
+  UPROPERTY(EditAnywhere)
+  bool bCollisionOnlyOnDedicatedServer = true;
+
   /** Applied to every chunk. UV scale is 1.0 per 100.0 world units. */
   UPROPERTY(EditAnywhere, BlueprintReadWrite)
   UMaterialInterface* LandscapeMaterial;
 
+  /** Props such as rocks and grass scattered over each chunk as it is generated. Changes apply to chunks generated afterwards. */
+  UPROPERTY(EditAnywhere, BlueprintReadWrite)
+  TArray<FLandscapeScatterLayer> ScatterLayers;
+
+  /**
+   * Approximate memory budget in megabytes for loaded chunk meshes, chunk collision and pooled generation data.
+   * When exceeded, pooled data is released first and then the chunks furthest from the player are unloaded,
+   * and no chunks are loaded beyond the nearest evicted one until usage drops again. Terrain edits count against
+   * the budget but are never evicted, so the rest get what edits leave of it. Zero disables the budget.
+   */
+  UPROPERTY(EditAnywhere, meta=(ClampMin="0.0", ClampMax="65536.0"))
+  float MemoryBudgetMB = 0.f;
+
+  /** Current estimate, in bytes, of the memory counted against MemoryBudgetMB. */
+  UFUNCTION(BlueprintCallable)
+  int64 GetEstimatedMemoryUsage() const;
+
+  /** Upper limit on edited chunks whose rebuilt meshes are swapped in per frame; the rest wait for later frames. */
+  UPROPERTY(EditAnywhere, meta=(ClampMin="1", ClampMax="64"))
+  int32 MaxChunkRebuildsPerTick = 2;
+
+  /** Upper limit on newly generated chunks spawned per frame; the rest wait for later frames. */
+  UPROPERTY(EditAnywhere, meta=(ClampMin="1", ClampMax="64"))
+  int32 MaxChunkSpawnsPerTick = 4;
+
+  /**
+   * Chunk generation runs as tasks in stages: heights are sampled, then the mesh is built alongside heightfield
+   * collision being cooked. These limit how many chunks each stage works on at once.
+   */
+  UPROPERTY(EditAnywhere, meta=(ClampMin="1", ClampMax="64"))
+  int32 SampleConcurrency = 2;
+
+  UPROPERTY(EditAnywhere, meta=(ClampMin="1", ClampMax="64"))
+  int32 MeshConcurrency = 2;
+
+  UPROPERTY(EditAnywhere, meta=(ClampMin="1", ClampMax="64"))
+  int32 CookConcurrency = 2;
+
+  /**
+   * Scales generation between one chunk per stage at low task priority and the stage limits above at high priority,
+   * from game and render thread frame times and the number of chunks waiting: down while frames take longer than
+   * TargetFrameMs, up while they have time to spare and chunks are waiting.
+   */
+  UPROPERTY(EditAnywhere)
+  bool bAdaptiveConcurrency = true;
+
+  UPROPERTY(EditAnywhere, meta=(ClampMin="1.0", ClampMax="100.0", EditCondition="bAdaptiveConcurrency"))
+  float TargetFrameMs = 16.6f;
+
+  //==============================================================================
+  // Terrain editing
+  //
+  // Edits are kept as sparse per-chunk height offsets on top of the procedural height.
+  // Only the chunks a brush touches are re-meshed, and their meshes are replaced in place.
+
+  /**
+   * Saves edits to the world's chunk storage and loads them back as chunks stream in, before the chunks are
+   * generated, so that edits last between sessions and only those near streaming centers are kept in memory.
+   * Edits of chunks that have unloaded no longer affect terrain queries until the chunks stream back in.
+   */
+  UPROPERTY(EditAnywhere, Category = "Terrain Editing")
+  bool bPersistEdits = false;
+
+  /** Raises terrain within Radius of Location by up to Amount (lowers it when negative), with a smooth falloff. */
+  UFUNCTION(BlueprintCallable, Category = "Terrain Editing")
+  void AddHeight(FVector Location, float Radius, float Amount);
+
+  /** Pulls terrain within Radius of Location toward Location.Z; a Strength of 1 flattens it completely at the center. */
+  UFUNCTION(BlueprintCallable, Category = "Terrain Editing")
+  void Flatten(FVector Location, float Radius, float Strength = 1.f);
+
+  /** Relaxes terrain within Radius of Location toward the average height of its neighbors. */
+  UFUNCTION(BlueprintCallable, Category = "Terrain Editing")
+  void Smooth(FVector Location, float Radius, float Strength = 0.5f);
+
+  /** Removes all terrain edits, restoring the procedural height everywhere; with bPersistEdits, saved ones too. */
+  UFUNCTION(BlueprintCallable, Category = "Terrain Editing")
+  void ClearEdits();
+
+  //==============================================================================
+  // Terrain queries
+  //
+  // Cheap alternatives to line traces for finding the ground. Loaded chunks answer from the heights they were
+  // meshed from, on the same triangles as their mesh; anywhere else the procedural height and edits are
+  // evaluated directly. Safe to call from any thread. Only X and Y of each location are used.
+
+  /** World Z of the terrain surface below or above Location. */
+  UFUNCTION(BlueprintPure, Category = "Terrain Queries")
+  float GetHeightAt(FVector Location) const;
+
+  /** Unit surface normal of the terrain below or above Location. */
+  UFUNCTION(BlueprintPure, Category = "Terrain Queries")
+  FVector GetNormalAt(FVector Location) const;
+
+  /** GetHeightAt for many locations at once. */
+  UFUNCTION(BlueprintCallable, Category = "Terrain Queries")
+  void GetHeightsAt(const TArray<FVector> &Locations, TArray<float> &OutHeights) const;
+
+  /** GetNormalAt for many locations at once. */
+  UFUNCTION(BlueprintCallable, Category = "Terrain Queries")
+  void GetNormalsAt(const TArray<FVector> &Locations, TArray<FVector> &OutNormals) const;
+
   //==============================================================================
   // Runtime Virtual Texture support
   
@@ -75,6 +389,19 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = VirtualTexture, meta = (DisplayName = "Draw in Main Pass"))
 	ERuntimeVirtualTextureMainPassType VirtualTextureRenderPassType = ERuntimeVirtualTextureMainPassType::Exclusive;
 
+  /**
+   * A world height runtime virtual texture filled directly from the terrain height on worker threads, page by page
+   * as the renderer asks for them, instead of by drawing chunk meshes into it. Use it in place of a Runtime Virtual
+   * Texture Volume, for example as the heightfield of a Virtual Heightfield Mesh; it is never drawn into by chunks
+   * even if it is also listed in RuntimeVirtualTextures.
+   */
+  UPROPERTY(EditAnywhere, Category = VirtualTexture)
+  TObjectPtr<URuntimeVirtualTexture> HeightVirtualTexture;
+
+  /** World area covered by HeightVirtualTexture. Terrain height is encoded over this box's Z range. */
+  UPROPERTY(EditAnywhere, Category = VirtualTexture)
+  FBox HeightVirtualTextureBounds{FVector{-100000.f, -100000.f, -1000.f}, FVector{100000.f, 100000.f, 1000.f}};
+
   //==============================================================================
 
   AProceduralLandscape();
@@ -85,6 +412,7 @@ public:
 
 protected:
   void BeginPlay() override;
+  void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 private:
   struct Private;
@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "PerlinNoise.h"
+
+// 2D simplex noise with its analytic gradient, in the same form as noise::perlinNoise2D.
+//
+// Stefan Gustavson's construction: three corner contributions per sample instead of Perlin's four and no
+// axis-aligned artifacts, with the same 8 gradient directions and permutation as the Perlin noise. Result in (-1,1).
+
+namespace noise
+{
+  FORCEINLINE NoiseSample
+  simplexNoise2D(const float x, const float y)
+  {
+    constexpr float F2 = 0.36602540378f; // (sqrt(3) - 1) / 2: skews the input to the simplex grid
+    constexpr float G2 = 0.21132486540f; // (3 - sqrt(3)) / 6: unskews it back
+    constexpr float scale = 70.f;        // brings the result to about (-1,1)
+
+    const float skew = (x + y) * F2;
+    const int32 i = FMath::FloorToInt(x + skew);
+    const int32 j = FMath::FloorToInt(y + skew);
+    const float unskew = float(i + j) * G2;
+
+    // offsets from the three corners of the containing simplex
+    const float x0 = x - (float(i) - unskew);
+    const float y0 = y - (float(j) - unskew);
+    const int32 i1 = x0 > y0 ? 1 : 0;
+    const int32 j1 = 1 - i1;
+    const float x1 = x0 - float(i1) + G2;
+    const float y1 = y0 - float(j1) + G2;
+    const float x2 = x0 - 1.f + 2.f * G2;
+    const float y2 = y0 - 1.f + 2.f * G2;
+
+    NoiseSample sample{0.f, FVector2D::ZeroVector};
+
+    // t^4 (g . d) falloff per corner, and its derivative 4 t^3 (-2 d) (g . d) + t^4 g
+    auto addCorner = [&sample](const int32 hash, const float dx, const float dy)
+    {
+      const float t = 0.5f - dx * dx - dy * dy;
+      if (t <= 0.f)
+        return;
+
+      const float gx = perlinGradientX[hash], gy = perlinGradientY[hash];
+      const float t2 = t * t;
+      const float t4 = t2 * t2;
+      const float dot = gx * dx + gy * dy;
+
+      sample.value += t4 * dot;
+      sample.gradient.X += t4 * gx - 8.f * t2 * t * dx * dot;
+      sample.gradient.Y += t4 * gy - 8.f * t2 * t * dy * dot;
+    };
+
+    addCorner(perlinHash(i, j), x0, y0);
+    addCorner(perlinHash(i + i1, j + j1), x1, y1);
+    addCorner(perlinHash(i + 1, j + 1), x2, y2);
+
+    sample.value *= scale;
+    sample.gradient *= scale;
+    return sample;
+  }
+} // namespace noise
@@ -25,3 +25,20 @@ void ASpawnable::Tick(float DeltaTime)
 
 }
 
+void ASpawnable::TakeFromPool(const FTransform &transform)
+{
+	SetActorTransform(transform, false, nullptr, ETeleportType::ResetPhysics);
+	SetActorHiddenInGame(false);
+	SetActorEnableCollision(true);
+	SetActorTickEnabled(PrimaryActorTick.bStartWithTickEnabled);
+
+	OnTakenFromPool();
+}
+
+void ASpawnable::ReturnToPool()
+{
+	SetActorHiddenInGame(true);
+	SetActorEnableCollision(false);
+	SetActorTickEnabled(false);
+}
+
@@ -30,4 +30,14 @@ public:
 
 	UPROPERTY(BlueprintReadOnly);
 	UMaterialInterface *material;
+
+	/** Called by AASpawner to reuse this actor after ReturnToPool; material has already been set. */
+	void TakeFromPool(const FTransform &transform);
+
+	/** Called by AASpawner when despawning: hides the actor and stops its collision and tick. */
+	void ReturnToPool();
+
+	/** Runs when a pooled actor is reused, since its construction script won't run again; apply material here. */
+	UFUNCTION(BlueprintImplementableEvent)
+	void OnTakenFromPool();
 };
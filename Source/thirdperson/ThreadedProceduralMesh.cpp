@@ -3,16 +3,10 @@
 
 #include "ThreadedProceduralMesh.h"
 #include "ProceduralMeshComponent.h"
-#include "Chunk.h"
-#include "HAL/RunnableThread.h"
-
-#include <condition_variable>
-#include <deque>
-#include <memory>
-#include <mutex>
-#include <stack>
-
-#include "Kismet/GameplayStatics.h"
+#include "ProceduralGenerationSubsystem.h"
+#include "Hash/CityHash.h"
+#include "MeshDescription.h"
+#include "StaticMeshAttributes.h"
 
 namespace
 {
@@ -21,6 +15,7 @@ namespace
     int32 xSteps, ySteps;
     float xTotalUnits, yTotalUnits;
   };
+  static_assert(sizeof(MeshParameters) == 16, "MeshParameters is hashed bytewise so it must have no padding");
 
   struct MeshData
   {
@@ -32,12 +27,6 @@ namespace
     TArray<FProcMeshTangent> tangents;
   };
 
-  struct GenerationWorkUnit
-  {
-    MeshData meshData{};
-    MeshParameters meshParameters{};
-  };
-
   //------------------------------------------------------------------------------
 
   void generateMesh(MeshData &meshData, const MeshParameters meshParameters)
@@ -88,9 +77,55 @@ namespace
     UE_LOG(LogTemp, Warning, TEXT("generateMesh(): count(%d)"), count);
   }
 
-  void generateMesh(GenerationWorkUnit &workUnit)
+  // identifies the mesh that meshParameters generate, so that actors with the same parameters share one mesh
+  uint64
+  hashMeshParameters(const MeshParameters &meshParameters)
   {
-    generateMesh(workUnit.meshData, workUnit.meshParameters);
+    return CityHash64(reinterpret_cast<const char*>(&meshParameters), sizeof(MeshParameters));
+  }
+
+  void
+  buildMeshDescription(FMeshDescription &meshDescription, const MeshData &meshData)
+  {
+    FStaticMeshAttributes attributes{meshDescription};
+    attributes.Register();
+
+    const TVertexAttributesRef<FVector3f> positions = attributes.GetVertexPositions();
+    const TVertexInstanceAttributesRef<FVector3f> normals = attributes.GetVertexInstanceNormals();
+    const TVertexInstanceAttributesRef<FVector3f> tangents = attributes.GetVertexInstanceTangents();
+    const TVertexInstanceAttributesRef<FVector2f> uvs = attributes.GetVertexInstanceUVs();
+    const TVertexInstanceAttributesRef<FVector4f> colors = attributes.GetVertexInstanceColors();
+
+    const int32 numVertices = meshData.vertices.Num();
+    const int32 numTriangles = meshData.triangles.Num() / 3;
+    meshDescription.ReserveNewVertices(numVertices);
+    meshDescription.ReserveNewVertexInstances(numVertices);
+    meshDescription.ReserveNewTriangles(numTriangles);
+    meshDescription.ReserveNewPolygons(numTriangles);
+
+    const FPolygonGroupID polygonGroup = meshDescription.CreatePolygonGroup();
+
+    // one instance per vertex, so instance IDs are the mesh data's vertex indices
+    for (int32 i = 0; i < numVertices; ++i)
+    {
+      const FVertexID vertex = meshDescription.CreateVertex();
+      positions[vertex] = FVector3f{meshData.vertices[i]};
+
+      const FVertexInstanceID instance = meshDescription.CreateVertexInstance(vertex);
+      normals[instance] = FVector3f{meshData.normals[i]};
+      tangents[instance] = FVector3f{meshData.tangents[i].TangentX};
+      uvs.Set(instance, 0, FVector2f{meshData.uv0[i]});
+      colors[instance] = FVector4f{meshData.colors[i]};
+    }
+
+    for (int32 i = 0; i < numTriangles; ++i)
+    {
+      const FVertexInstanceID corners[3]{
+        FVertexInstanceID(meshData.triangles[3 * i]),
+        FVertexInstanceID(meshData.triangles[3 * i + 1]),
+        FVertexInstanceID(meshData.triangles[3 * i + 2])};
+      meshDescription.CreateTriangle(polygonGroup, corners);
+    }
   }
 
   MeshParameters
@@ -118,134 +153,12 @@ namespace
 
 //==============================================================================
 
-class MeshGenerator : public FRunnable
-{
-  std::mutex workMutex;
-  std::condition_variable workConditionVariable; // main notifies workers
-  std::deque<std::unique_ptr<GenerationWorkUnit>> workQueue; // lock before access
-  bool shouldStop{}; // set true then notify workConditionVariable then wait for worker to finish
-
-  std::mutex doneMutex;
-  std::deque<std::unique_ptr<GenerationWorkUnit>> doneQueue; // lock before access
-  
-  FRunnableThread* thread;
-  
-public:
-  MeshGenerator()
-    : thread{FRunnableThread::Create(this, TEXT("MeshGeneratorThread"))}
-  {}
-
-  ~MeshGenerator() override
-  {
-    if (thread)
-    {
-      thread->Kill(true);
-      delete thread;
-    }
-  }
-
-  //------------------------------------------------------------------------------
-  // FRunnable
-
-  // bool Init() override {}
-
-  uint32 Run() override
-  {
-    UE_LOG(LogTemp, Warning, TEXT("MeshGenerator::Run() starting"));
-
-    for (;;)
-    {
-      std::unique_ptr<GenerationWorkUnit> workUnit;
-
-      {
-        std::unique_lock lock(workMutex);
-        workConditionVariable.wait(lock, [this] { return shouldStop || !workQueue.empty(); });
-
-        if (shouldStop)
-          break;
-
-        workUnit = std::move(workQueue.front());
-        workQueue.pop_front();
-      }
-
-      UE_LOG(LogTemp, Warning, TEXT("MeshGenerator::Run() generating mesh"));
-      ::generateMesh(*workUnit);
-
-      {
-        std::lock_guard lock(doneMutex);
-        doneQueue.push_back(std::move(workUnit));
-      }
-    }
-
-    UE_LOG(LogTemp, Warning, TEXT("MeshGenerator::Run() returning"));
-
-    return 0;
-  }
-
-  void Stop() override
-  {
-    shouldStop = true;
-    workConditionVariable.notify_all();
-  }
-  
-  // void Exit() override;
-
-  //------------------------------------------------------------------------------
-
-  void generateMesh(std::unique_ptr<GenerationWorkUnit> workUnit)
-  {
-    {
-      std::lock_guard lock(workMutex);
-      workQueue.push_back(std::move( workUnit ));
-    }
-    workConditionVariable.notify_one();
-  }
-
-  std::unique_ptr<GenerationWorkUnit>
-  getCompletedMesh()
-  {
-    std::lock_guard lock(doneMutex);
-
-    if (!doneQueue.empty())
-    {
-      std::unique_ptr workUnit = std::move(doneQueue.front());
-      doneQueue.pop_front();
-      return workUnit;
-    }
-
-    return nullptr;
-  }
-};
-
-//==============================================================================
-
 struct AThreadedProceduralMesh::Private
 {
-  std::unique_ptr<MeshGenerator> meshGenerator;
-
   UProceduralMeshComponent* mesh;
 
-  std::stack<std::unique_ptr<GenerationWorkUnit>> unusedWorkUnits;
-
   bool generated{};
   bool generating{};
-
-  std::unique_ptr<GenerationWorkUnit>
-  getUnusedWorkUnit()
-  {
-    if (unusedWorkUnits.empty())
-      return std::make_unique<GenerationWorkUnit>();
-
-    std::unique_ptr workUnit = std::move(unusedWorkUnits.top());
-    unusedWorkUnits.pop();
-    return workUnit;
-  }
-
-  void
-  putUnusedWorkUnit( std::unique_ptr<GenerationWorkUnit> workUnit)
-  {
-    unusedWorkUnits.push(std::move(workUnit));
-  }
 };
 
 //==============================================================================
@@ -264,20 +177,14 @@ AThreadedProceduralMesh::AThreadedProceduralMesh()
       meshParameters.ySteps = 1;
 
       {
-        std::unique_ptr workUnit = p->getUnusedWorkUnit();
-
-        workUnit->meshParameters = meshParameters;
-        generateMesh(*workUnit);
-        createProceduralMeshSection(p->mesh, 0, workUnit->meshData);
-
-        p->putUnusedWorkUnit(std::move(workUnit));
+        MeshData meshData;
+        generateMesh(meshData, meshParameters);
+        createProceduralMeshSection(p->mesh, 0, meshData);
       }
     }
 
     RootComponent = p->mesh;
   }
-  
-  p->meshGenerator = std::make_unique<MeshGenerator>();
 
   // not sure if I need all of these but it seems Unreal changes how ticks work from version to version and this combo works
   PrimaryActorTick.bCanEverTick = true;
@@ -297,6 +204,14 @@ void AThreadedProceduralMesh::BeginPlay()
   SetActorHiddenInGame(true);
 }
 
+void AThreadedProceduralMesh::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+  if (UProceduralGenerationSubsystem *generation = GetWorld()->GetSubsystem<UProceduralGenerationSubsystem>())
+    generation->RemoveSharedMeshInstance(this);
+
+  Super::EndPlay(EndPlayReason);
+}
+
 void AThreadedProceduralMesh::OnConstruction(const FTransform& Transform)
 {
   Super::OnConstruction(Transform);
@@ -308,42 +223,33 @@ void AThreadedProceduralMesh::Tick(float DeltaTime)
 {
   Super::Tick(DeltaTime);
 
-  if (!p->generated)
-  {
-    if (!p->generating)
-    {
-      UE_LOG(LogTemp, Warning, TEXT("AThreadedProceduralMesh::Tick(): enqueing mesh generation"));
-      std::unique_ptr workUnit = p->getUnusedWorkUnit();
-      workUnit->meshParameters = getMeshParameters(*this);
-      p->generating = true;
-      p->meshGenerator->generateMesh(std::move(workUnit));
-    }
-    else
-    {
-      UE_LOG(LogTemp, Warning, TEXT("AThreadedProceduralMesh::Tick(): checking if generation done"));
+  if (p->generated || p->generating)
+    return;
 
-      if (std::unique_ptr workUnit = p->meshGenerator->getCompletedMesh())
-      {
-        UE_LOG(LogTemp, Warning, TEXT("AThreadedProceduralMesh::Tick(): got generated mesh; setting mesh section"));
-
-        const auto location = GetTransform().GetLocation();
-        UE_LOG(LogTemp, Warning, TEXT("AThreadedProceduralMesh::Tick(): creating AChunk at (%f,%f,%f)"), location.X,
-               location.Y, location.Z);
+  // generated on the world's shared generation threads, which every procedural actor uses;
+  // actors with the same parameters share one mesh, drawn through one instanced component
+  UProceduralGenerationSubsystem *generation = GetWorld()->GetSubsystem<UProceduralGenerationSubsystem>();
+  if (!generation)
+    return;
 
-        AChunk* chunk = GetWorld()->SpawnActorDeferred<AChunk>(AChunk::StaticClass(), FTransform());
+  UE_LOG(LogTemp, Warning, TEXT("AThreadedProceduralMesh::Tick(): requesting shared mesh"));
+  const MeshParameters meshParameters = getMeshParameters(*this);
+  p->generating = true;
 
-        // createProceduralMeshSection(chunk->mesh, 0, workUnit->meshData);
-        p->putUnusedWorkUnit(std::move(workUnit));
-        chunk->StaticMeshComponent->SetMaterial(0, Material);
-        chunk->SetFolderPath("/Chunks");
+  generation->RequestSharedMesh(hashMeshParameters(meshParameters), this,
+    [meshParameters](FMeshDescription &meshDescription)
+    {
+      MeshData meshData;
+      generateMesh(meshData, meshParameters);
+      buildMeshDescription(meshDescription, meshData);
+    },
+    [this, generation](UStaticMesh *staticMesh)
+    {
+      UE_LOG(LogTemp, Warning, TEXT("AThreadedProceduralMesh::Tick(): got shared mesh; adding instance"));
 
-        // chunk->SetActorTransform(GetTransform());
-        UGameplayStatics::FinishSpawningActor(chunk, GetTransform());
+      generation->AddSharedMeshInstance(staticMesh, Material, GetTransform(), this);
 
-        p->generating = false;
-        p->generated = true;
-      }
-    }
-  }
+      p->generating = false;
+      p->generated = true;
+    });
 }
-
@@ -54,6 +54,7 @@ public:
 protected:
   // Called when the game starts or when spawned
   void BeginPlay() override;
+  void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 private:
   struct Private;
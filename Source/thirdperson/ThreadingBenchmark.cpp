@@ -0,0 +1,381 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ThreadingBenchmark.h"
+
+#include "Async/AsyncWork.h"
+#include "Async/ParallelFor.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Tasks/Task.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  enum class Strategy
+  {
+    Runnable,
+    AutoDeleteAsyncTask,
+    ParallelFor,
+    Tasks,
+    StdThread,
+  };
+
+  const TCHAR *
+  strategyName(const Strategy strategy)
+  {
+    switch (strategy)
+    {
+    case Strategy::Runnable: return TEXT("FRunnable");
+    case Strategy::AutoDeleteAsyncTask: return TEXT("FAutoDeleteAsyncTask");
+    case Strategy::ParallelFor: return TEXT("ParallelFor");
+    case Strategy::Tasks: return TEXT("UE::Tasks");
+    case Strategy::StdThread: return TEXT("std::thread");
+    }
+    return TEXT("");
+  }
+
+  bool
+  startsOwnThreads(const Strategy strategy)
+  {
+    return strategy == Strategy::Runnable || strategy == Strategy::StdThread;
+  }
+
+  bool
+  isPrime(const int64 n)
+  {
+    if (n < 2)
+      return false;
+
+    for (int64 i = 2; i * i <= n; ++i)
+      if (n % i == 0)
+        return false;
+
+    return true;
+  }
+
+  //------------------------------------------------------------------------------
+
+  // The numbers [2, rangeEnd) cut into tasks of grain numbers each, which any thread may run in any order.
+  struct Workload
+  {
+    const int64 rangeEnd;
+    const int32 grain;
+    const int32 numTasks;
+
+    std::atomic<int32> nextTask{0};      // for threads that take tasks until none are left
+    std::atomic<int32> tasksDone{0};
+    std::atomic<int64> primesFound{0};
+    std::atomic<uint64> workCycles{0};   // time spent inside tasks, summed over threads
+
+    Workload(const int64 rangeEnd, const int32 grain)
+      : rangeEnd{rangeEnd}
+      , grain{grain}
+      , numTasks{int32((rangeEnd - 2 + grain - 1) / grain)}
+    {}
+
+    void
+    runTask(const int32 task)
+    {
+      const uint64 startCycles = FPlatformTime::Cycles64();
+
+      const int64 first = 2 + int64(task) * grain;
+      const int64 end = FMath::Min(first + grain, rangeEnd);
+
+      int64 primes = 0;
+      for (int64 n = first; n < end; ++n)
+        primes += isPrime(n);
+
+      primesFound += primes;
+      workCycles += FPlatformTime::Cycles64() - startCycles;
+      ++tasksDone;
+    }
+
+    void
+    runTasksUntilNoneLeft()
+    {
+      for (int32 task; (task = nextTask++) < numTasks;)
+        runTask(task);
+    }
+
+    bool
+    isDone() const { return tasksDone == numTasks; }
+  };
+
+  class RunnableWorker : public FRunnable
+  {
+    Workload &workload;
+
+  public:
+    explicit RunnableWorker(Workload &workload) : workload{workload} {}
+
+    uint32 Run() override
+    {
+      workload.runTasksUntilNoneLeft();
+      return 0;
+    }
+  };
+
+  class WorkloadTask : public FNonAbandonableTask
+  {
+    Workload &workload;
+    int32 task;
+
+  public:
+    WorkloadTask(Workload &workload, const int32 task) : workload{workload}, task{task} {}
+
+    TStatId GetStatId() const
+    {
+      RETURN_QUICK_DECLARE_CYCLE_STAT(WorkloadTask, STATGROUP_ThreadPoolAsyncTasks);
+    }
+
+    void DoWork() { workload.runTask(task); }
+  };
+
+  //------------------------------------------------------------------------------
+
+  // Stands in for the game thread: a fixed amount of work per frame, which takes frameMs when nothing else runs.
+  class SimulatedFrame
+  {
+    uint64 iterations = 1;
+    volatile uint64 sink = 0;
+
+  public:
+    void
+    calibrate(const double frameMs)
+    {
+      iterations = 1 << 10;
+      while (run() < frameMs)
+        iterations *= 2;
+
+      iterations = FMath::Max<uint64>(1, uint64(iterations * frameMs / run()));
+    }
+
+    // returns how long the frame took, in milliseconds
+    double
+    run()
+    {
+      const double startSeconds = FPlatformTime::Seconds();
+
+      uint64 x = sink;
+      for (uint64 i = 0; i < iterations; ++i)
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+      sink = x;
+
+      return 1000.0 * (FPlatformTime::Seconds() - startSeconds);
+    }
+  };
+
+  struct Result
+  {
+    Strategy strategy;
+    int32 numThreads;
+    int32 grain;
+    int32 numTasks;
+    double wallSeconds;
+    double workSeconds;
+    int64 primesFound;
+    int32 frames;
+    double frameMsAverage;
+    double frameMsMax;
+  };
+
+  Result
+  runBenchmark(const Strategy strategy, const int64 rangeEnd, const int32 grain, const int32 numThreads, SimulatedFrame &frame)
+  {
+    Workload workload{rangeEnd, grain};
+
+    Result result{strategy, numThreads, grain, workload.numTasks};
+    double frameMsTotal = 0.0;
+
+    auto runFramesUntilDone = [&]
+    {
+      while (!workload.isDone())
+      {
+        const double frameMs = frame.run();
+        frameMsTotal += frameMs;
+        result.frameMsMax = FMath::Max(result.frameMsMax, frameMs);
+        ++result.frames;
+      }
+    };
+
+    const double startSeconds = FPlatformTime::Seconds();
+
+    switch (strategy)
+    {
+    case Strategy::Runnable:
+      {
+        std::vector<std::unique_ptr<RunnableWorker>> workers;
+        TArray<FRunnableThread*> threads;
+        for (int32 i = 0; i < numThreads; ++i)
+        {
+          workers.push_back(std::make_unique<RunnableWorker>(workload));
+          threads.Add(FRunnableThread::Create(workers.back().get(), *FString::Printf(TEXT("ThreadingBenchmark%d"), i)));
+        }
+
+        runFramesUntilDone();
+
+        for (FRunnableThread *thread : threads)
+        {
+          thread->WaitForCompletion();
+          delete thread;
+        }
+      }
+      break;
+
+    case Strategy::AutoDeleteAsyncTask:
+      for (int32 task = 0; task < workload.numTasks; ++task)
+        (new FAutoDeleteAsyncTask<WorkloadTask>(workload, task))->StartBackgroundTask();
+
+      runFramesUntilDone();
+      break;
+
+    case Strategy::ParallelFor:
+      {
+        // blocks the caller, which helps with the work instead of running frames
+        ParallelFor(workload.numTasks, [&](const int32 task) { workload.runTask(task); });
+
+        const double frameMs = 1000.0 * (FPlatformTime::Seconds() - startSeconds);
+        frameMsTotal = result.frameMsMax = frameMs;
+        result.frames = 1;
+      }
+      break;
+
+    case Strategy::Tasks:
+      {
+        TArray<UE::Tasks::FTask> tasks;
+        tasks.Reserve(workload.numTasks);
+        for (int32 task = 0; task < workload.numTasks; ++task)
+          tasks.Add(UE::Tasks::Launch(UE_SOURCE_LOCATION, [&workload, task] { workload.runTask(task); }));
+
+        runFramesUntilDone();
+        UE::Tasks::Wait(tasks);
+      }
+      break;
+
+    case Strategy::StdThread:
+      {
+        std::vector<std::thread> threads;
+        for (int32 i = 0; i < numThreads; ++i)
+          threads.emplace_back([&workload] { workload.runTasksUntilNoneLeft(); });
+
+        runFramesUntilDone();
+
+        for (std::thread &thread : threads)
+          thread.join();
+      }
+      break;
+    }
+
+    result.wallSeconds = FPlatformTime::Seconds() - startSeconds;
+    result.workSeconds = FPlatformTime::ToSeconds64(workload.workCycles);
+    result.primesFound = workload.primesFound;
+    result.frameMsAverage = result.frames > 0 ? frameMsTotal / result.frames : 0.0;
+    return result;
+  }
+
+  TArray<int32>
+  parseIntList(const FString &params, const TCHAR *key, TArray<int32> defaults)
+  {
+    FString list;
+    if (!FParse::Value(*params, key, list, false))
+      return defaults;
+
+    TArray<FString> items;
+    list.ParseIntoArray(items, TEXT(","));
+
+    TArray<int32> values;
+    for (const FString &item : items)
+      if (const int32 value = FCString::Atoi(*item); value > 0)
+        values.Add(value);
+
+    return values.IsEmpty() ? defaults : values;
+  }
+} // namespace
+
+//==============================================================================
+
+UThreadingBenchmarkCommandlet::UThreadingBenchmarkCommandlet()
+{
+  IsClient = false;
+  IsServer = false;
+  IsEditor = false;
+  LogToConsole = true;
+}
+
+int32 UThreadingBenchmarkCommandlet::Main(const FString &Params)
+{
+  int64 rangeEnd = 2000000;
+  FParse::Value(*Params, TEXT("range="), rangeEnd);
+  rangeEnd = FMath::Max<int64>(rangeEnd, 3);
+
+  double frameMs = 8.0;
+  FParse::Value(*Params, TEXT("frameMs="), frameMs);
+  frameMs = FMath::Max(frameMs, 0.1);
+
+  const TArray<int32> grains = parseIntList(Params, TEXT("grains="), {100, 1000, 10000});
+  const TArray<int32> threadCounts = parseIntList(Params, TEXT("threads="), {1, 2, 4, 8});
+
+  FString csvPath = FPaths::ProjectSavedDir() / TEXT("Benchmarks")
+    / FString::Printf(TEXT("ThreadingBenchmark-%s.csv"), *FDateTime::Now().ToString());
+  FParse::Value(*Params, TEXT("csv="), csvPath);
+
+  SimulatedFrame frame;
+  frame.calibrate(frameMs);
+
+  // what a frame takes with nothing else running, after calibration
+  double baselineFrameMs = 0.0;
+  for (int32 i = 0; i < 10; ++i)
+    baselineFrameMs += frame.run() / 10;
+
+  // workers that the engine's shared strategies run on, for their rows' thread counts
+  const int32 taskGraphThreads = FTaskGraphInterface::Get().GetNumWorkerThreads() + 1; // and the caller, for ParallelFor
+  const int32 threadPoolThreads = GThreadPool ? GThreadPool->GetNumThreads() : 0;
+
+  UE_LOG(LogTemp, Display, TEXT("ThreadingBenchmark: numbers below %lld, %.2f ms baseline frame, %d task graph workers, %d thread pool threads"),
+    rangeEnd, baselineFrameMs, taskGraphThreads - 1, threadPoolThreads);
+
+  FString csv = TEXT("strategy,threads,grain,tasks,wall_s,work_s,primes,numbers_per_s,overhead_us_per_task,frames,frame_ms_avg,frame_ms_max,frame_ms_baseline\n");
+
+  for (const int32 grain : grains)
+    for (const Strategy strategy : {Strategy::Runnable, Strategy::AutoDeleteAsyncTask, Strategy::ParallelFor, Strategy::Tasks, Strategy::StdThread})
+    {
+      TArray<int32> strategyThreadCounts = threadCounts;
+      if (!startsOwnThreads(strategy))
+        strategyThreadCounts = {strategy == Strategy::AutoDeleteAsyncTask ? threadPoolThreads : taskGraphThreads};
+
+      for (const int32 numThreads : strategyThreadCounts)
+      {
+        const Result result = runBenchmark(strategy, rangeEnd, grain, numThreads, frame);
+
+        // thread time not spent inside tasks: starting threads, queueing, waking, waiting for the last task
+        const double overheadSeconds = FMath::Max(0.0, result.wallSeconds * result.numThreads - result.workSeconds);
+        const double numbersPerSecond = (rangeEnd - 2) / result.wallSeconds;
+
+        UE_LOG(LogTemp, Display,
+          TEXT("ThreadingBenchmark: %-20s %2d threads, grain %6d: %8.3f s, %12.0f numbers/s, %8.2f us overhead/task, %.2f ms average frame, %.2f ms max"),
+          strategyName(strategy), result.numThreads, grain, result.wallSeconds, numbersPerSecond,
+          1e6 * overheadSeconds / result.numTasks, result.frameMsAverage, result.frameMsMax);
+
+        csv += FString::Printf(TEXT("%s,%d,%d,%d,%.6f,%.6f,%lld,%.0f,%.3f,%d,%.3f,%.3f,%.3f\n"),
+          strategyName(strategy), result.numThreads, grain, result.numTasks, result.wallSeconds, result.workSeconds,
+          result.primesFound, numbersPerSecond, 1e6 * overheadSeconds / result.numTasks,
+          result.frames, result.frameMsAverage, result.frameMsMax, baselineFrameMs);
+      }
+    }
+
+  if (!FFileHelper::SaveStringToFile(csv, *csvPath))
+  {
+    UE_LOG(LogTemp, Error, TEXT("ThreadingBenchmark: couldn't write %s"), *csvPath);
+    return 1;
+  }
+
+  UE_LOG(LogTemp, Display, TEXT("ThreadingBenchmark: wrote %s"), *csvPath);
+  return 0;
+}
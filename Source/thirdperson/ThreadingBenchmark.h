@@ -0,0 +1,35 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+#include "ThreadingBenchmark.generated.h"
+
+/**
+ * Runs the same prime-testing workload APrimesThreadTest uses through each way of threading the engine offers,
+ * sweeping thread counts and task sizes, and writes throughput, scheduling overhead and game thread impact to CSV.
+ *
+ * The workload tests every number in a range for primality by trial division, cut into tasks of Grain numbers.
+ * While it runs, the calling thread stands in for the game thread: it runs frames of a fixed amount of work and
+ * records how much longer they take than they did before the benchmark started. ParallelFor blocks its caller,
+ * so it shows up as one frame as long as the whole run.
+ *
+ * Headless:
+ *   UnrealEditor-Cmd thirdperson.uproject -run=ThreadingBenchmark [-range=2000000] [-grains=100,1000,10000]
+ *     [-threads=1,2,4,8] [-frameMs=8] [-csv=Saved/Benchmarks/threading.csv]
+ *
+ * Thread counts apply to FRunnable and std::thread, which start their own threads. FAutoDeleteAsyncTask,
+ * ParallelFor and UE::Tasks run on the engine's shared workers, so they run once per task size with those.
+ */
+UCLASS()
+class THIRDPERSON_API UThreadingBenchmarkCommandlet : public UCommandlet
+{
+  GENERATED_BODY()
+
+public:
+  UThreadingBenchmarkCommandlet();
+
+  int32 Main(const FString &Params) override;
+};
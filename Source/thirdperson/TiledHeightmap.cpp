@@ -0,0 +1,222 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TiledHeightmap.h"
+
+#include "Async/MappedFileHandle.h"
+#include "HAL/PlatformFileManager.h"
+#include "IImageWrapper.h"
+#include "IImageWrapperModule.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Modules/ModuleManager.h"
+
+namespace
+{
+  struct TiledHeightmapHeader
+  {
+    uint32 magic;
+    uint32 version;
+    uint32 width;
+    uint32 height;
+    uint32 tileSize;
+  };
+
+  // Reads numRows full rows of heights starting at firstRow into out.
+  using ReadRows = TFunction<bool(int32 firstRow, int32 numRows, uint16 *out)>;
+
+  bool
+  writeTiled(IFileHandle &file, const int32 width, const int32 height, const int32 tileSize, const ReadRows &readRows)
+  {
+    TiledHeightmapHeader header{FTiledHeightmap::Magic, FTiledHeightmap::Version, uint32(width), uint32(height), uint32(tileSize)};
+    TArray<uint8> headerBytes;
+    headerBytes.SetNumZeroed(FTiledHeightmap::DataOffset);
+    FMemory::Memcpy(headerBytes.GetData(), &header, sizeof(header));
+    if (!file.Write(headerBytes.GetData(), headerBytes.Num()))
+      return false;
+
+    const int32 tilesX = FMath::DivideAndRoundUp(width, tileSize);
+    const int32 tilesY = FMath::DivideAndRoundUp(height, tileSize);
+
+    TArray<uint16> band; // tileSize rows of the source
+    band.SetNumUninitialized(int64(width) * tileSize);
+    TArray<uint16> tile;
+    tile.SetNumUninitialized(tileSize * tileSize);
+
+    for (int32 ty = 0; ty < tilesY; ++ty)
+    {
+      const int32 firstRow = ty * tileSize;
+      const int32 numRows = FMath::Min(tileSize, height - firstRow);
+      if (!readRows(firstRow, numRows, band.GetData()))
+        return false;
+
+      for (int32 tx = 0; tx < tilesX; ++tx)
+      {
+        const int32 firstColumn = tx * tileSize;
+
+        // past the edges the last row and column repeat, which is what sampling does anyway
+        for (int32 y = 0; y < tileSize; ++y)
+        {
+          const uint16 *row = &band[int64(FMath::Min(y, numRows - 1)) * width];
+          for (int32 x = 0; x < tileSize; ++x)
+            tile[y * tileSize + x] = row[FMath::Min(firstColumn + x, width - 1)];
+        }
+
+        if (!file.Write(reinterpret_cast<const uint8*>(tile.GetData()), tile.Num() * sizeof(uint16)))
+          return false;
+      }
+    }
+
+    return true;
+  }
+} // namespace
+
+//==============================================================================
+
+FTiledHeightmap::~FTiledHeightmap()
+{
+  // the region has to go before the file it maps
+  Region.Reset();
+  FileHandle.Reset();
+}
+
+TSharedPtr<const FTiledHeightmap, ESPMode::ThreadSafe> FTiledHeightmap::Open(const FString &Filename)
+{
+  TSharedPtr<FTiledHeightmap, ESPMode::ThreadSafe> heightmap = MakeShareable(new FTiledHeightmap);
+  const FString filename = FinishImport(Filename) ? Filename : GetImportedFilename(Filename);
+
+  heightmap->FileHandle.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*filename));
+  if (!heightmap->FileHandle || heightmap->FileHandle->GetFileSize() < DataOffset)
+  {
+    UE_LOG(LogTemp, Warning, TEXT("FTiledHeightmap: can't map %s"), *filename);
+    return nullptr;
+  }
+
+  // the whole file is mapped at once: that only reserves address space, pages come in as they are touched
+  heightmap->Region.Reset(heightmap->FileHandle->MapRegion(0, heightmap->FileHandle->GetFileSize()));
+  if (!heightmap->Region)
+  {
+    UE_LOG(LogTemp, Warning, TEXT("FTiledHeightmap: can't map %s"), *filename);
+    return nullptr;
+  }
+
+  TiledHeightmapHeader header;
+  FMemory::Memcpy(&header, heightmap->Region->GetMappedPtr(), sizeof(header));
+
+  const bool validHeader = header.magic == Magic && header.version == Version
+    && header.width > 0 && header.width <= uint32(MAX_int32) && header.height > 0 && header.height <= uint32(MAX_int32)
+    && header.tileSize > 0 && header.tileSize <= MaxTileSize && FMath::IsPowerOfTwo(header.tileSize);
+
+  // every tile has to be in the mapping; compared by division, since a damaged header can make the product overflow
+  const int64 tilesX = validHeader ? FMath::DivideAndRoundUp(header.width, header.tileSize) : 0;
+  const int64 tilesY = validHeader ? FMath::DivideAndRoundUp(header.height, header.tileSize) : 0;
+  const int64 tileBytes = int64(header.tileSize) * header.tileSize * sizeof(uint16);
+
+  if (!validHeader || tilesX * tilesY > (heightmap->Region->GetMappedSize() - DataOffset) / tileBytes)
+  {
+    UE_LOG(LogTemp, Warning, TEXT("FTiledHeightmap: %s isn't a tiled heightmap, see ImportHeightmap"), *filename);
+    return nullptr;
+  }
+
+  heightmap->Heights = reinterpret_cast<const uint16*>(heightmap->Region->GetMappedPtr() + DataOffset);
+  heightmap->Width = int32(header.width);
+  heightmap->Height = int32(header.height);
+  heightmap->TileShift = FMath::FloorLog2(header.tileSize);
+  heightmap->TileMask = int32(header.tileSize) - 1;
+  heightmap->TilesX = int32(tilesX);
+  return heightmap;
+}
+
+bool FTiledHeightmap::Import(const FString &SourceFilename, const FString &TiledFilename, const int32 TileSize)
+{
+  if (!FMath::IsPowerOfTwo(TileSize) || TileSize < 16 || uint32(TileSize) > MaxTileSize)
+    return false;
+
+  IPlatformFile &platformFile = FPlatformFileManager::Get().GetPlatformFile();
+  int32 width = 0, height = 0;
+  ReadRows readRows;
+
+  // PNG: decoded whole, then read from memory
+  TArray64<uint8> decoded;
+  TUniquePtr<IFileHandle> sourceFile;
+
+  if (FPaths::GetExtension(SourceFilename).Equals(TEXT("png"), ESearchCase::IgnoreCase))
+  {
+    TArray<uint8> compressed;
+    if (!FFileHelper::LoadFileToArray(compressed, *SourceFilename))
+      return false;
+
+    IImageWrapperModule &imageWrapperModule = FModuleManager::LoadModuleChecked<IImageWrapperModule>(TEXT("ImageWrapper"));
+    const TSharedPtr<IImageWrapper> imageWrapper = imageWrapperModule.CreateImageWrapper(EImageFormat::PNG);
+    if (!imageWrapper || !imageWrapper->SetCompressed(compressed.GetData(), compressed.Num())
+      || !imageWrapper->GetRaw(ERGBFormat::Gray, 16, decoded))
+    {
+      UE_LOG(LogTemp, Warning, TEXT("FTiledHeightmap: %s isn't a PNG that decodes to 16-bit grayscale"), *SourceFilename);
+      return false;
+    }
+    compressed.Empty();
+
+    width = imageWrapper->GetWidth();
+    height = imageWrapper->GetHeight();
+    readRows = [&](const int32 firstRow, const int32 numRows, uint16 *out)
+    {
+      FMemory::Memcpy(out, decoded.GetData() + int64(firstRow) * width * sizeof(uint16), int64(numRows) * width * sizeof(uint16));
+      return true;
+    };
+  }
+  else
+  {
+    // RAW: no header, so it has to be square
+    sourceFile.Reset(platformFile.OpenRead(*SourceFilename));
+    if (!sourceFile)
+      return false;
+
+    const int64 numTexels = sourceFile->Size() / int64(sizeof(uint16));
+    width = height = int32(FMath::Sqrt(double(numTexels)) + 0.5);
+    if (int64(width) * height != numTexels)
+    {
+      UE_LOG(LogTemp, Warning, TEXT("FTiledHeightmap: %s isn't a square 16-bit RAW heightmap"), *SourceFilename);
+      return false;
+    }
+
+    readRows = [&](const int32 firstRow, const int32 numRows, uint16 *out)
+    {
+      return sourceFile->Seek(int64(firstRow) * width * sizeof(uint16))
+        && sourceFile->Read(reinterpret_cast<uint8*>(out), int64(numRows) * width * sizeof(uint16));
+    };
+  }
+
+  const FString importedFilename = GetImportedFilename(TiledFilename);
+  TUniquePtr<IFileHandle> tiledFile{platformFile.OpenWrite(*importedFilename)};
+  if (!tiledFile)
+  {
+    UE_LOG(LogTemp, Warning, TEXT("FTiledHeightmap: can't write %s"), *importedFilename);
+    return false;
+  }
+
+  const double startSeconds = FPlatformTime::Seconds();
+  if (!writeTiled(*tiledFile, width, height, TileSize, readRows) || !tiledFile->Flush())
+  {
+    UE_LOG(LogTemp, Warning, TEXT("FTiledHeightmap: writing %s failed"), *importedFilename);
+    tiledFile.Reset();
+    platformFile.DeleteFile(*importedFilename);
+    return false;
+  }
+
+  UE_LOG(LogTemp, Log, TEXT("FTiledHeightmap: imported %s (%d x %d) to %s in %.1f s"),
+    *SourceFilename, width, height, *importedFilename, FPlatformTime::Seconds() - startSeconds);
+  return true;
+}
+
+bool FTiledHeightmap::FinishImport(const FString &TiledFilename)
+{
+  IPlatformFile &platformFile = FPlatformFileManager::Get().GetPlatformFile();
+  const FString importedFilename = GetImportedFilename(TiledFilename);
+  if (!platformFile.FileExists(*importedFilename))
+    return true;
+
+  if (platformFile.FileExists(*TiledFilename) && !platformFile.DeleteFile(*TiledFilename))
+    return false;
+
+  return platformFile.MoveFile(*TiledFilename, *importedFilename);
+}
@@ -0,0 +1,151 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HeightSources.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+// Large heightmaps as a height source, read through a memory mapping of a tiled file so that only the tiles
+// under the chunks being generated are ever paged in, and resident memory is up to the OS page cache.
+//
+// Tiled file layout, little-endian:
+//   header: magic, version, width, height, tileSize (uint32 each), zero-padded to DataOffset
+//   tiles:  row-major grid of tiles, each tileSize^2 uint16 heights row-major; edge tiles padded with edge heights
+// Tiles are whole pages apart, so neighboring chunks share as few pages as possible.
+
+/** A read-only memory-mapped tiled heightmap. Immutable once opened, so any number of threads may sample it without locking. */
+class FTiledHeightmap
+{
+public:
+  static constexpr uint32 Magic = 0x314d4854; // "THM1"
+  static constexpr uint32 Version = 1;
+  static constexpr int64 DataOffset = 4096;
+  static constexpr uint32 MaxTileSize = 4096;
+
+  ~FTiledHeightmap();
+
+  /**
+   * Maps a tiled heightmap file, after finishing an import to it if there is one; null if it can't be opened or
+   * isn't one. An import that can't be moved into place yet is mapped where it was written.
+   */
+  static TSharedPtr<const FTiledHeightmap, ESPMode::ThreadSafe> Open(const FString &Filename);
+
+  /**
+   * Converts a 16-bit grayscale PNG, or a square little-endian 16-bit RAW, into a tiled heightmap file.
+   * The RAW is read a band of tiles at a time; PNGs are decoded whole first.
+   *
+   * The file is written to GetImportedFilename(TiledFilename) rather than over TiledFilename, which may be mapped;
+   * FinishImport moves it into place.
+   */
+  static bool Import(const FString &SourceFilename, const FString &TiledFilename, int32 TileSize = 256);
+
+  /** Where Import writes the tiled file until FinishImport moves it to TiledFilename. */
+  static FString GetImportedFilename(const FString &TiledFilename) { return TiledFilename + TEXT(".importing"); }
+
+  /**
+   * Replaces TiledFilename with the file imported to it, if there is one; false if it can't be, which is the case
+   * while either file is still mapped on some platforms. True if there is nothing to replace.
+   */
+  static bool FinishImport(const FString &TiledFilename);
+
+  int32 GetWidth() const { return Width; }
+  int32 GetHeight() const { return Height; }
+
+  /** Height at a texel, in [0,1]; texels outside the heightmap repeat its edges. */
+  FORCEINLINE float
+  Texel(int32 X, int32 Y) const
+  {
+    X = FMath::Clamp(X, 0, Width - 1);
+    Y = FMath::Clamp(Y, 0, Height - 1);
+    const int32 tile = (Y >> TileShift) * TilesX + (X >> TileShift);
+    const int32 inTile = ((Y & TileMask) << TileShift) + (X & TileMask);
+    return Heights[(int64(tile) << (2 * TileShift)) + inTile] * (1.f / 65535.f);
+  }
+
+private:
+  FTiledHeightmap() = default;
+
+  TUniquePtr<IMappedFileHandle> FileHandle;
+  TUniquePtr<IMappedFileRegion> Region;
+  const uint16 *Heights = nullptr;
+  int32 Width = 0, Height = 0;
+  int32 TileShift = 0, TileMask = 0, TilesX = 0;
+};
+
+namespace noise
+{
+  // A tiled heightmap in noise space: one unit per texel, with texel centers on whole coordinates,
+  // and height in [0,1]. Filtered bilinearly, or with Catmull-Rom bicubics for smooth slopes at any resolution.
+  template<bool bBicubic>
+  struct Heightmap
+  {
+    const FTiledHeightmap *heightmap;
+
+    FORCEINLINE NoiseSample
+    operator()(const float x, const float y) const
+    {
+      const float xFloor = FMath::FloorToFloat(x);
+      const float yFloor = FMath::FloorToFloat(y);
+      const int32 xi = int32(xFloor);
+      const int32 yi = int32(yFloor);
+      const float fx = x - xFloor;
+      const float fy = y - yFloor;
+
+      if constexpr (!bBicubic)
+      {
+        const float h00 = heightmap->Texel(xi, yi);
+        const float h10 = heightmap->Texel(xi + 1, yi);
+        const float h01 = heightmap->Texel(xi, yi + 1);
+        const float h11 = heightmap->Texel(xi + 1, yi + 1);
+
+        const float h0 = h00 + (h10 - h00) * fx;
+        const float h1 = h01 + (h11 - h01) * fx;
+
+        return {
+          h0 + (h1 - h0) * fy,
+          {(h10 - h00) * (1.f - fy) + (h11 - h01) * fy, h1 - h0}};
+      }
+      else
+      {
+        float wx[4], wy[4], dwx[4], dwy[4];
+        catmullRomWeights(fx, wx, dwx);
+        catmullRomWeights(fy, wy, dwy);
+
+        NoiseSample sample{0.f, FVector2D::ZeroVector};
+        for (int32 j = 0; j < 4; ++j)
+        {
+          float row = 0.f, rowDx = 0.f;
+          for (int32 i = 0; i < 4; ++i)
+          {
+            const float h = heightmap->Texel(xi + i - 1, yi + j - 1);
+            row += wx[i] * h;
+            rowDx += dwx[i] * h;
+          }
+          sample.value += wy[j] * row;
+          sample.gradient.X += wy[j] * rowDx;
+          sample.gradient.Y += dwy[j] * row;
+        }
+        return sample;
+      }
+    }
+
+  private:
+    // weights of the four texels around t in [0,1), and their derivatives
+    static FORCEINLINE void
+    catmullRomWeights(const float t, float (&w)[4], float (&dw)[4])
+    {
+      const float t2 = t * t, t3 = t2 * t;
+      w[0] = -0.5f * t3 + t2 - 0.5f * t;
+      w[1] = 1.5f * t3 - 2.5f * t2 + 1.f;
+      w[2] = -1.5f * t3 + 2.f * t2 + 0.5f * t;
+      w[3] = 0.5f * t3 - 0.5f * t2;
+      dw[0] = -1.5f * t2 + 2.f * t - 0.5f;
+      dw[1] = 4.5f * t2 - 5.f * t;
+      dw[2] = -4.5f * t2 + 4.f * t + 0.5f;
+      dw[3] = 1.5f * t2 - t;
+    }
+  };
+} // namespace noise
@@ -15,8 +15,11 @@ public class thirdperson : ModuleRules
 			{
 				"Core", "CoreUObject", "Engine", "InputCore", "HeadMountedDisplay",
 				"ProceduralMeshComponent",
-				"MeshDescription",
-				"VirtualHeightfieldMesh"
+				"MeshDescription", "StaticMeshDescription",
+				"VirtualHeightfieldMesh",
+				"Chaos", "PhysicsCore",
+				"RenderCore", "RHI",
+				"ImageWrapper"
 			});
 	}
 }
\ No newline at end of file